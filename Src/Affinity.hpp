@@ -0,0 +1,80 @@
+/****************************************************************/
+/*                                                              */
+/*  Copyright (C) 2018, M. Andelkovic, L. Covaci, A. Ferreira,  */
+/*                    S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                              */
+/****************************************************************/
+
+/*
+  Binding of the threads to the cores.
+
+  Each thread owns one domain of the lattice. The domains are numbered with a[0] as
+  the fastest direction, so the threads with consecutive numbers are mostly neighbours,
+  and a block of consecutive threads is a slab of the lattice. The cores are ordered
+  by socket and then by core, and consecutive threads get consecutive cores. Each socket
+  then holds a slab of domains, and only the faces between slabs are exchanged across sockets.
+
+  The threads are bound before the Simulation is constructed. The KPM vectors, the Anderson
+  disorder and the buffers of the ghosts are then allocated and first touched by the thread
+  that owns them, so they are placed in the memory of its socket.
+
+  Nothing is done if the binding was already chosen with OMP_PROC_BIND, OMP_PLACES or GOMP_CPU_AFFINITY.
+*/
+
+#if PIN_THREADS && defined(__linux__)
+
+int read_topology(int cpu, const char * field) {
+  // Reads a number from the description of the cpu in /sys, -1 if it is not there
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + field);
+  int value = -1;
+  if(file)
+    file >> value;
+  return value;
+}
+
+const std::vector<int> & sorted_cpus() {
+  // The cpus available to the program, ordered by socket and core. It is found by the first
+  // thread that asks for it, before any thread is bound
+  static const std::vector<int> cpus = [] {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> list;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0)
+      for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	if(CPU_ISSET(cpu, &set))
+	  list.push_back(cpu);
+
+    std::vector<std::array<int, 3>> keys;
+    for(auto cpu = list.begin(); cpu != list.end(); cpu++)
+      keys.push_back({read_topology(*cpu, "physical_package_id"), read_topology(*cpu, "core_id"), *cpu});
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<int> sorted;
+    for(auto k = keys.begin(); k != keys.end(); k++)
+      sorted.push_back(k->at(2));
+    return sorted;
+  }();
+  return cpus;
+}
+
+void pin_thread(unsigned thread_id, unsigned n_threads) {
+  if(omp_get_proc_bind() != omp_proc_bind_false || std::getenv("OMP_PLACES") || std::getenv("GOMP_CPU_AFFINITY"))
+    return;
+
+  const std::vector<int> & cpus = sorted_cpus();
+  if(cpus.empty())
+    return;
+
+  // With fewer threads than cpus the threads are spread over all the sockets
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpus.at(std::size_t(thread_id) * cpus.size() / n_threads), &set);
+  if(sched_setaffinity(0, sizeof(set), &set) != 0)
+    debug_message("Could not bind the thread to a core.\n");
+}
+
+#else
+
+void pin_thread(unsigned, unsigned) {}
+
+#endif
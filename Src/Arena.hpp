@@ -0,0 +1,98 @@
+/****************************************************************/
+/*                                                              */
+/*  Copyright (C) 2018, M. Andelkovic, L. Covaci, A. Ferreira,  */
+/*                    S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                              */
+/****************************************************************/
+
+/*
+  Storage of the KPM vectors of one thread.
+
+  Every measurement of the queue constructs and destroys its own KPM vectors. Instead of
+  returning their memory to the system, the arena keeps it and hands it to the vectors of
+  the next measurements, so the pages are not faulted in again each time. The blocks are
+  aligned to 64 bytes. Blocks of at least one huge page are aligned to the huge pages and,
+  on Linux, marked for transparent huge pages, which cuts the TLB misses when sweeping
+  vectors of several GB.
+
+  When no free block is large enough, the free blocks are released before allocating a new
+  one, so the arena never holds more memory than the vectors alive at the same time.
+*/
+
+#define ARENA_ALIGNMENT   64
+#define HUGE_PAGE_SIZE    (std::size_t(2) << 20)
+
+template <typename T>
+class KPM_Arena {
+  struct Block {
+    T * data;
+    std::size_t size;   // Number of elements of type T
+  };
+  std::vector<Block> free_blocks;
+  std::vector<Block> used_blocks;
+
+public:
+  KPM_Arena() {};
+  KPM_Arena(const KPM_Arena &) = delete;
+  KPM_Arena & operator=(const KPM_Arena &) = delete;
+
+  ~KPM_Arena() {
+    for(auto b = used_blocks.begin(); b != used_blocks.end(); b++)
+      free(b->data);
+    clear();
+  };
+
+  T * allocate(std::size_t size) {
+    // Reuse the smallest free block that is large enough
+    auto best = free_blocks.end();
+    for(auto b = free_blocks.begin(); b != free_blocks.end(); b++)
+      if(b->size >= size && (best == free_blocks.end() || b->size < best->size))
+	best = b;
+
+    if(best == free_blocks.end())
+      {
+	clear();
+	used_blocks.push_back({new_block(size), size});
+      }
+    else
+      {
+	used_blocks.push_back(*best);
+	free_blocks.erase(best);
+      }
+    return used_blocks.back().data;
+  };
+
+  void release(T * data) {
+    for(auto b = used_blocks.begin(); b != used_blocks.end(); b++)
+      if(b->data == data)
+	{
+	  free_blocks.push_back(*b);
+	  used_blocks.erase(b);
+	  return;
+	}
+  };
+
+  void clear() {
+    // Returns the free blocks to the system
+    for(auto b = free_blocks.begin(); b != free_blocks.end(); b++)
+      free(b->data);
+    free_blocks.clear();
+  };
+
+private:
+  T * new_block(std::size_t size) {
+    const std::size_t bytes = std::max(size, std::size_t(1)) * sizeof(T);
+    const std::size_t alignment = (bytes >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : ARENA_ALIGNMENT);
+    void * data = nullptr;
+    if(posix_memalign(&data, alignment, bytes) != 0)
+      {
+	std::cout << "Could not allocate " << bytes << " bytes for the KPM vectors. Exiting.\n";
+	exit(1);
+      }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if(bytes >= HUGE_PAGE_SIZE)
+      madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+    return static_cast<T *>(data);
+  };
+};
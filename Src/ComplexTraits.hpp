@@ -54,3 +54,25 @@ typename std::enable_if<is_tt<std::complex, T>::value, T>::type assign_value(dou
   typedef typename extract_value_type<T>::value_type value_type;
   return T(value_type(x),value_type(y));
 };
+
+/*
+  Type in which the products between KPM vectors and the moments are summed.
+  With MIXED_PRECISION the vectors in single precision are stored and iterated in float,
+  but their products are accumulated in double, which keeps the high order moments accurate
+*/
+template <typename T>
+struct accumulate_type {
+  typedef T type;
+};
+
+#if MIXED_PRECISION
+template <>
+struct accumulate_type<float> {
+  typedef double type;
+};
+
+template <>
+struct accumulate_type<std::complex<float>> {
+  typedef std::complex<double> type;
+};
+#endif
@@ -0,0 +1,235 @@
+/****************************************************************/
+/*                                                              */
+/*  Copyright (C) 2018, M. Andelkovic, L. Covaci, A. Ferreira,  */
+/*                    S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                              */
+/****************************************************************/
+
+/*
+  Description of the system in the configuration file.
+
+  The file is read once by the master thread, before the parallel region. Every thread then
+  builds its own domain, Hamiltonian and disorder from this object, which is not changed
+  afterwards, so the threads neither open the file nor wait for each other when they start.
+*/
+
+extern "C" herr_t getMembers(hid_t loc_id, const char *name, void *opdata);
+
+struct Vacancy_Description {
+  double              concentration;
+  std::vector<int>    orbitals;
+};
+
+template <typename T>
+struct Defect_Description {
+  double                   concentration;
+  std::vector<unsigned>    node_position;   // Positions of the nodes in the basis with 3 cells along each direction
+  std::vector<int>         node_to;         // Nodes of the bonds
+  std::vector<int>         node_from;
+  std::vector<T>           hopping;
+  std::vector<int>         node_onsite;     // Nodes with local energies
+  std::vector<T>           U;
+};
+
+template <typename T, unsigned D>
+struct Configuration {
+  /* Lattice */
+  unsigned                              Orb;               // Number of orbitals
+  Eigen::Matrix<double, D, D>           rLat;              // The vectors are organized by columns
+  Eigen::MatrixXd                       rOrb;              // The vectors of each orbital are organized by columns
+  unsigned                              Lt[D];             // Dimensions of the global sample
+  unsigned                              Bd[D];             // Periodic or non-periodic boundary conditions
+  unsigned                              nd[D];             // Number of domains in each dimension
+  unsigned                              nghosts;           // Width of the ghosts
+  int                                   MagneticField;     // Number of flux quanta of the magnetic field
+
+  /* Periodic part of the Hamiltonian */
+  Eigen::Array<unsigned, Eigen::Dynamic, 1>            NHoppings;
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic>   distance;
+  Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>      hopping;
+
+  /* Disorder */
+  std::vector<int>                      orb_num;           // Anderson disorder
+  std::vector<int>                      model;
+  std::vector<double>                   mu;
+  std::vector<double>                   sigma;
+  std::vector<Vacancy_Description>      vacancies;
+  std::vector<Defect_Description<T>>    defects;
+
+  Configuration(char *name) {
+    debug_message("Entered Configuration\n");
+    H5::H5File *file = new H5::H5File(name, H5F_ACC_RDONLY);
+    read_lattice(file);
+    read_hoppings(file);
+    read_Anderson_disorder(file);
+    read_vacancies(file);
+    read_defects(file);
+    delete file;
+    debug_message("Left Configuration\n");
+  };
+
+  void read_lattice(H5::H5File *file) {
+    get_hdf5<unsigned>(&Orb, file, (char *) "/NOrbitals");
+    get_hdf5<double>(rLat.data(), file, (char *) "/LattVectors");
+    rOrb = Eigen::MatrixXd::Zero(D, Orb);
+    get_hdf5<double>(rOrb.data(), file, (char *) "/OrbPositions");
+
+    get_hdf5<unsigned>(Lt, file, (char *) "/L");
+    get_hdf5<unsigned>(Bd, file, (char *) "/Boundaries");
+    get_hdf5<unsigned>(nd, file, (char *) "/Divisions");
+
+    // Width of the ghosts. This is optional, it only has to be changed for very long range hoppings or defects
+    nghosts = NGHOSTS;
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<unsigned>(&nghosts, file, (char *) "/NGhosts");
+    } catch(H5::Exception& e) {}
+
+    // Magnetic field perpendicular to a[0] and a[1]. This is optional, without it the default of the compilation is used
+    MagneticField = NUM_GHOST_CORR;
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<int>(&MagneticField, file, (char *) "/Hamiltonian/MagneticField");
+    } catch(H5::Exception& e) {}
+  };
+
+  void read_hoppings(H5::H5File *file) {
+    NHoppings = Eigen::Array<unsigned, Eigen::Dynamic, 1 > (Orb);
+    get_hdf5<unsigned>(NHoppings.data(), file, (char *) "/Hamiltonian/NHoppings");
+
+    std::size_t max = NHoppings.maxCoeff();
+    distance = Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic>(max, Orb);
+    hopping  = Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>(max, Orb);
+    get_hdf5<T>(hopping.data(), file, (char *) "/Hamiltonian/Hoppings");          // Read Hoppings
+    get_hdf5<int>(distance.data(), file, (char *) "/Hamiltonian/d");              // Read the distances
+  };
+
+  void read_Anderson_disorder(H5::H5File *file) {
+    /*
+     * Gaussian      : 1
+     * Uniform       : 2
+     * Deterministic : 3
+     */
+    H5::DataSet   dataset    = H5::DataSet(file->openDataSet("/Hamiltonian/Disorder/OrbitalNum"));
+    H5::DataSpace dataspace  = dataset.getSpace();
+    size_t        m          = dataspace.getSimpleExtentNpoints();
+
+    orb_num.resize(m);
+    model.resize(m);
+    mu.resize(m);
+    sigma.resize(m);
+    try {
+      get_hdf5<int>(orb_num.data(), file, (char *) "/Hamiltonian/Disorder/OrbitalNum");               // read the orbitals that have local disorder
+      get_hdf5<int> (model.data(), file, (char *) "/Hamiltonian/Disorder/OnsiteDisorderModelType");   // read the the type  of local disorder
+      get_hdf5<double> (mu.data(), file, (char *) "/Hamiltonian/Disorder/OnsiteDisorderMeanValue");   // read the the mean value
+      get_hdf5<double> (sigma.data(), file, (char *) "/Hamiltonian/Disorder/OnsiteDisorderMeanStdv"); // read the the variance
+    }
+    catch (...){}
+  };
+
+  void read_vacancies(H5::H5File *file) {
+    // Test if there is vacancies to build
+    H5::Group  grp;
+    std::vector<std::string> names;
+    int n;
+
+    try {
+      H5::Exception::dontPrint();
+      grp = file->openGroup("/Hamiltonian/Vacancy");
+      // Get the names of the Vacancies Types
+      grp.iterateElems(grp.getObjName(), NULL, getMembers, static_cast<void*>(&names));
+      for(auto id = names.begin(); id != names.end(); id++)
+	{
+	  Vacancy_Description vacancy;
+	  std::string field = *id + std::string("/Concentration");
+	  get_hdf5<double> ( &vacancy.concentration, file, field );
+	  field = *id + std::string("/NumOrbitals");
+	  get_hdf5<int> ( &n, file, field );
+	  vacancy.orbitals.resize(n);
+	  field = *id + std::string("/Orbitals");
+	  get_hdf5<int> ( vacancy.orbitals.data(), file, field );
+	  vacancies.push_back(vacancy);
+	}
+    }
+    catch(H5::Exception& e) {
+      // Do nothing
+    }
+  };
+
+  void read_defects(H5::H5File *file) {
+    // Test if there is a strutural disorder to build
+    H5::Group  grp;
+    std::vector<std::string> names;
+    try {
+      H5::Exception::dontPrint();
+      grp = file->openGroup("/Hamiltonian/StructuralDisorder");
+      grp.iterateElems(grp.getObjName(), NULL, getMembers, static_cast<void*>(&names) );
+      for(auto id = names.begin(); id != names.end(); id++)
+	defects.push_back(read_defect(file, *id));
+    }
+    catch(H5::Exception& e) {
+      // Do nothing
+    }
+  };
+
+  Defect_Description<T> read_defect(H5::H5File *file, const std::string & defect) {
+    Defect_Description<T> d;
+    unsigned NumberNodes;
+    int n;
+
+    std::string field = defect + std::string("/Concentration");
+    get_hdf5<double> ( &d.concentration, file, field );
+
+    /* Read Number of nodes and their relative  positions */
+    field = defect + std::string("/NumNodes");
+    get_hdf5<unsigned> ( &NumberNodes, file, field );
+    d.node_position.resize(NumberNodes);
+    field = defect + std::string("/NodePosition");
+    get_hdf5<unsigned> ( d.node_position.data(), file, field );
+
+    /* Read Hoppings */
+    field = defect + std::string("/NumBondDisorder");
+    get_hdf5<int> ( &n, file, field );
+    d.node_to.resize(n);
+    d.node_from.resize(n);
+    d.hopping.resize(n);
+    field = defect + std::string("/NodeTo");
+    get_hdf5<int> (d.node_to.data(), file, field );
+    field = defect + std::string("/NodeFrom");
+    get_hdf5<int> (d.node_from.data(), file, field );
+    field = defect + std::string("/Hopping");
+    get_hdf5<T> (d.hopping.data(), file, field );
+
+    /* Read local Disorder */
+    field = defect + std::string("/NumOnsiteDisorder");
+    get_hdf5<int> ( &n, file, field );
+    d.node_onsite.resize(n);
+    d.U.resize(n);
+    field = defect + std::string("/NodeOnsite");
+    get_hdf5<int> (d.node_onsite.data(), file, field );
+    field = defect + std::string("/U0");
+    get_hdf5<T> (d.U.data(), file, field );
+    return d;
+  };
+};
+
+
+herr_t getMembers(hid_t loc_id, const char *name, void *opdata)
+{
+  H5::Group  grp(loc_id);
+  std::string Disorder = grp.getObjName();
+  std::string  sep = "/";
+  std::string Defect = name;
+  std::string group = Disorder+sep+name;
+  std::vector<std::string> * v = static_cast<std::vector<std::string> *> (opdata);
+
+  try {
+    H5::Exception::dontPrint();
+    grp.openGroup(group);
+    v->push_back(group);
+  }
+  catch(H5::Exception& e) {
+    // Don't do nothing
+  }
+  return 0;
+}
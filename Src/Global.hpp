@@ -6,22 +6,23 @@
 /****************************************************************/
 
 template <typename T>
-struct GLOBAL_VARIABLES {
-  std::vector<T> ghosts;
+struct Border_Defects {
+  // Bonds and local energies of the defects of a domain that fall in the ghosts of one of its sides,
+  // to be added by the neighbour domain that owns those sites
   std::vector<std::size_t>    element1;
   std::vector<std::ptrdiff_t> element2_diff;
   std::vector<T> hopping;
   std::vector<std::size_t>    element;
   std::vector<T> U;
 
-  // Averages
-  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> mu;
-  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> gamma;
-  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> lambda;
-  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> singleshot_cond;
-  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> general_gamma;
-  double kpm_iteration_time;
-  GLOBAL_VARIABLES() { };
+  void clear() {
+    element1.clear();
+    element2_diff.clear();
+    hopping.clear();
+    element.clear();
+    U.clear();
+  }
+  
   void addbond( std::size_t  ele1, std::ptrdiff_t ele2, T hop ) {
     element1.push_back(ele1);
     element2_diff.push_back(ele2); 
@@ -33,3 +34,28 @@ struct GLOBAL_VARIABLES {
     U.push_back(u);
   }
 };
+
+template <typename T>
+struct GLOBAL_VARIABLES {
+  std::vector<std::vector<T>> ghosts; // Buffers of the ghosts of each thread
+  std::vector<std::size_t>    exchange_flags; // Last exchange of the ghosts sent by each thread along each direction
+  std::vector<std::size_t>    exchange_acks;  // Number of times the faces of each thread were read by its neighbours
+  std::vector<T*>             ghost_columns;  // Columns whose faces are being sent by each thread
+  static const unsigned       flag_stride = 8; // The flags are kept in different cache lines
+  std::vector<Border_Defects<T>> outbox; // Broken defects sent by each thread to each of its 3^D neighbours
+
+  // Averages
+  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> mu;
+  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> gamma;
+  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> lambda;
+  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> singleshot_cond;
+  Eigen::Array <T, Eigen::Dynamic, Eigen::Dynamic> general_gamma;
+  Statistics<typename accumulate_type<T>::type> statistics; // Mean and variance of the Gamma matrix being calculated
+  double kpm_iteration_time;
+  unsigned block_size;       // Number of random vectors iterated together in the block recursion
+  int memory;                // Number of KPM vectors stored in the memory while calculating Gamma2D
+  std::size_t memory_budget; // Bytes of all the threads for the KPM vectors of Gamma2D, 0 to store memory vectors
+  std::size_t stride;        // Size of the tiles swept by the KPM iteration
+  std::uint64_t seed;        // Seed of the random numbers of the disorder and of the random vectors
+  GLOBAL_VARIABLES() { };
+};
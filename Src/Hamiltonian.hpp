@@ -11,7 +11,6 @@
 #include "HamiltonianDefects.hpp"
 #include "HamiltonianRegular.hpp"
 #include "HamiltonianVacancies.hpp"
-extern "C" herr_t getMembers(hid_t loc_id, const char *name, void *opdata);
 
 template <typename T, unsigned D>
 class Hamiltonian {
@@ -28,9 +27,10 @@ public:
   std::vector <double> mu;
   std::vector <double> sigma;
   
-  std::vector<value_type> U_Orbital;
-  std::vector<value_type> U_Anderson;      // Local disorder  
-  std::vector<int> Anderson_orb_address;
+  bool onsite_disorder;                    // True if the disorder has on-site energies
+  bool defect_energies;                    // True if the defects have on-site energies
+  std::vector<value_type> diagonal;        // On-site energies of each site of the domain, empty when nothing is stored
+  std::vector<int> orbital_model;          // Model of the local disorder of each orbital, -1 if there is none
   
   /*   Structural disorder    */
   std::vector <bool>                   cross_mozaic;
@@ -44,10 +44,18 @@ public:
     build_Anderson_disorder();
     build_vacancies_disorder();    
     build_structural_disorder();
+    defect_energies = false;
+    for(auto id = hd.begin(); id != hd.end(); id++)
+      if(!id->U.empty())
+	defect_energies = true;
+    onsite_disorder = onsite_disorder || defect_energies;
+    // The multiplications that time the iterations run before the first realization
+    allocate_diagonal();
   };
   
   void generate_disorder()
   {
+    simul.rnd.realization++;
     distribute_AndersonDisorder();
     for(std::size_t istr = 0; istr < r.NStr; istr++)
       cross_mozaic[istr] = true;
@@ -55,71 +63,30 @@ public:
 
     hV.generate_disorder();
     for(auto id = hd.begin(); id != hd.end(); id++)
-      id->generate_disorder();
-    
+      {
+	id->generate_disorder();
+	if(!diagonal.empty())
+	  id->add_onsite_energies(diagonal);
+      }
 
   };
   
   void build_structural_disorder()
   {
-    
-#pragma omp critical
-    {
-      H5::H5File *file = new H5::H5File(simul.name, H5F_ACC_RDONLY);
-      // Test if there is a strutural disorder to build
-      H5::Group  grp;
-      std::vector<std::string> defects;
-      try {
-	H5::Exception::dontPrint();
-	grp = file->openGroup("/Hamiltonian/StructuralDisorder");
-	grp.iterateElems(grp.getObjName(), NULL, getMembers, static_cast<void*>(&defects) );
-	
-	for(auto id = defects.begin(); id != defects.end(); id++)
-	  hd.push_back(Defect_Operator<T,D> ( simul, *id, file) );
-      }
-      catch(H5::Exception& e) {
-	// Do nothing
-      }
-      delete file;
-    }
+    const std::vector<Defect_Description<T>> & defects = simul.config.defects;
+    for(auto id = defects.begin(); id != defects.end(); id++)
+      hd.push_back(Defect_Operator<T,D> ( simul, *id, unsigned(hd.size())) );
   }
 
   void build_vacancies_disorder()
   {
     r.SizetVacancies = 0;
-#pragma omp critical
-    {
-      H5::H5File *file = new H5::H5File(simul.name, H5F_ACC_RDONLY);
-      // Test if there is vacancies to build
-      H5::Group  grp;
-      double p;
-      std::vector<int> orbit;
-      std::vector<std::string> vacancies;
-      int n;
-      
-      try {
-	H5::Exception::dontPrint();
-	grp = file->openGroup("/Hamiltonian/Vacancy");
-	// Get the names of the Vacancies Types
-	grp.iterateElems(grp.getObjName(), NULL, getMembers, static_cast<void*>(&vacancies)); 
-	for(auto id = vacancies.begin(); id != vacancies.end(); id++)
-	  {
-	    std::string field = *id + std::string("/Concentration");
-	    get_hdf5<double> ( &p, file, field );
-	    field = *id + std::string("/NumOrbitals");
-	    get_hdf5<int> ( &n, file, field );
-	    orbit.resize(n);
-	    field = *id + std::string("/Orbitals");
-	    get_hdf5<int> ( orbit.data(), file, field );
-	    hV.add_model(p, orbit);
-	  }
-      }
-      catch(H5::Exception& e) {
-	// Do nothing
+    const std::vector<Vacancy_Description> & vacancies = simul.config.vacancies;
+    for(auto id = vacancies.begin(); id != vacancies.end(); id++)
+      {
+	std::vector<int> orbit = id->orbitals;
+	hV.add_model(id->concentration, orbit);
       }
-      delete file;
-    }
-    
   }
   
   
@@ -129,51 +96,20 @@ public:
      * Uniform       : 2
      * Deterministic : 3
      */
-#pragma omp critical
-    {
-      H5::H5File    *file      = new H5::H5File(simul.name, H5F_ACC_RDONLY);
-      H5::DataSet   dataset    = H5::DataSet(file->openDataSet("/Hamiltonian/Disorder/OrbitalNum"));
-      H5::DataSpace dataspace  = dataset.getSpace();
-      size_t        m          = dataspace.getSimpleExtentNpoints();
-      
-      orb_num.resize(m);
-      model.resize(m);
-      mu.resize(m);
-      sigma.resize(m);
-      try {
-	get_hdf5<int>(orb_num.data(), file, (char *) "/Hamiltonian/Disorder/OrbitalNum");               // read the orbitals that have local disorder
-      	get_hdf5<int> (model.data(), file, (char *) "/Hamiltonian/Disorder/OnsiteDisorderModelType");   // read the the type  of local disorder
-      	get_hdf5<double> (mu.data(), file, (char *) "/Hamiltonian/Disorder/OnsiteDisorderMeanValue");   // read the the mean value
-      	get_hdf5<double> (sigma.data(), file, (char *) "/Hamiltonian/Disorder/OnsiteDisorderMeanStdv"); // read the the variance
-      }
-	catch (...){}
-      delete file;
-    }
+    orb_num = simul.config.orb_num;
+    model   = simul.config.model;
+    mu      = simul.config.mu;
+    sigma   = simul.config.sigma;
     
-    Anderson_orb_address.resize(r.Orb);
-    U_Orbital.resize(r.Orb);
-    
-    std::fill_n ( Anderson_orb_address.begin(), r.Orb, -2 );
-    std::fill_n ( U_Orbital.begin(), r.Orb,  0 );
-    
-    int sum = 0;
+    // The on-site energies are only stored when there is some local disorder
+    onsite_disorder = false;
+    orbital_model.assign(r.Orb, -1);
     for (unsigned i = 0; i < model.size(); i++)
-      {
-	if(model.at(i) < 3)
-	  {
-	    Anderson_orb_address.at( orb_num.at(i) ) = sum;
-	    sum++;
-	  }
-	
-	if(model.at(i) == 3) // Deterministic
-	  {
-	    Anderson_orb_address.at( orb_num.at(i) ) = -1;
-	    U_Orbital.at( orb_num.at(i) ) = mu.at(i);
-	  }
-      }
-    
-    if(sum > 0)
-      U_Anderson.resize( sum * r.Nd);    
+      if(model.at(i) >= 1 && model.at(i) <= 3)
+	{
+	  onsite_disorder = true;
+	  orbital_model.at(orb_num.at(i)) = i;
+	}
   }
   
   void build_velocity(std::vector<unsigned> & components, unsigned n)
@@ -190,22 +126,82 @@ public:
      * Gaussian      : 1
      * Uniform       : 2
      * Deterministic : 3
+     *
+     * The energies of the orbital io are in diagonal[io * Nd, (io + 1) * Nd), the local
+     * energies of the defects are added to them after the defects are distributed
      */
     
-    int sum = 0;
-    for (unsigned i = 0; i < model.size(); i++)
-      if(model.at(i) == 1 )
-	{
-	  for(unsigned j = 0; j < r.Nd; j++)
-            U_Anderson.at(sum + j) = simul.rnd.gaussian(mu.at(i), sigma.at(i)) ;
-	  sum += r.Nd;
-	}
-      else if ( model.at(i) == 2 )
-	{
-	  for(unsigned j = 0; j < r.Nd; j++)
-            U_Anderson.at(sum + j) = simul.rnd.uniform(mu.at(i), sigma.at(i)) ;
-	  sum += r.Nd;
-	}
+    allocate_diagonal();
+#if ANDERSON_ON_THE_FLY
+    return;
+#endif
+    if(diagonal.empty())
+      return;
+    
+    // The energies are found row by row, only in the sites of the domain
+    Coordinates<std::size_t, D + 1> latt(r.ld), Latt(r.Ld);
+    for(std::size_t io = 0; io < r.Orb; io++)
+      if(orbital_model.at(io) >= 0)
+	for(std::size_t i = 0; i < r.N; i += r.ld[0])
+	  {
+	    latt.set_coord(i + io * r.N);
+	    r.convertCoordinates(Latt, latt);
+	    anderson_energies(Latt.index, r.ld[0], &diagonal[Latt.index]);
+	  }
+  }
+  
+  void allocate_diagonal()
+  {
+    // Zero on-site energies in every site of the domain, when they are stored. With
+    // ANDERSON_ON_THE_FLY only the local energies of the defects are stored, the energies
+    // of the orbitals are found in onsite_energies from the realization and the site
+#if ANDERSON_ON_THE_FLY
+    const bool stored = defect_energies;
+#else
+    const bool stored = onsite_disorder;
+#endif
+    if(stored)
+      diagonal.assign(r.Sized, value_type(0));
+    else
+      diagonal.clear();
+  }
+  
+  void anderson_energies(std::size_t j, std::size_t width, value_type * u)
+  {
+    // Anderson energies of the sites j, ..., j + width - 1 of a row of the domain. They only
+    // depend on the realization and on the global indexes of the sites
+    const int i = orbital_model.at(j / r.Nd);
+    if(i < 0)
+      std::fill_n(u, width, value_type(0));
+    else if(model.at(i) == 3)
+      std::fill_n(u, width, value_type(mu.at(i)));
+    else
+      {
+	// The global indexes are consecutive along the row
+	Coordinates<std::ptrdiff_t, D + 1> local(r.Ld), global(r.Lt);
+	r.convertCoordinates(global, local.set_coord(std::ptrdiff_t(j)));
+	const std::uint64_t g = global.index, stream = simul.rnd.stream(ANDERSON, i);
+	if(model.at(i) == 1)
+	  for(std::size_t k = 0; k < width; k++)
+	    u[k] = simul.rnd.gaussian(g + k, stream, mu.at(i), sigma.at(i));
+	else
+	  for(std::size_t k = 0; k < width; k++)
+	    u[k] = simul.rnd.uniform(g + k, stream, mu.at(i), sigma.at(i));
+      }
+  }
+  
+  const value_type * onsite_energies(std::size_t j, std::size_t width, value_type * buffer)
+  {
+    // On-site energies of the sites j, ..., j + width - 1 of a row of the domain
+#if ANDERSON_ON_THE_FLY
+    anderson_energies(j, width, buffer);
+    if(!diagonal.empty())
+      for(std::size_t k = 0; k < width; k++)
+	buffer[k] += diagonal[j + k];
+    return buffer;
+#else
+    return (diagonal.empty() ? nullptr : & diagonal[j]);
+#endif
   }
   template <typename U = T>
   typename std::enable_if<is_tt<std::complex, U>::value, U>::type ghosts_correlation(double phase) {
@@ -221,24 +217,4 @@ public:
 };
 
 
-herr_t getMembers(hid_t loc_id, const char *name, void *opdata)
-{
-  H5::Group  grp(loc_id);
-  std::string Disorder = grp.getObjName();
-  std::string  sep = "/";
-  std::string Defect = name;
-  std::string group = Disorder+sep+name; 
-  std::vector<std::string> * v = static_cast<std::vector<std::string> *> (opdata);
-
-  try {
-    H5::Exception::dontPrint();
-    grp.openGroup(group);
-    v->push_back(group);
-  }
-  catch(H5::Exception& e) {
-    // Don't do nothing 
-  }
-  return 0;
-}
-
 #endif
@@ -9,6 +9,7 @@ template <typename T,unsigned D>
 struct Defect_Operator  {
   typedef typename extract_value_type<T>::value_type value_type;
   double                                   p;                        // Concentration of defects
+  unsigned                            number;                        // Number of the defect, which sets its random numbers
   unsigned                       NumberNodes;                        // Number of nodes in the deffect
   std::vector <T>                          U;                        // local energies
   std::vector <unsigned>             element;                        // nodes with local energies
@@ -31,66 +32,24 @@ struct Defect_Operator  {
   Eigen::Array<T, -1, -1>        new_hopping;
 
   
-  Defect_Operator(Simulation <T,D> & sim, std::string & defect, H5::H5File *file) : r(sim.r), simul(sim), position(sim.r.NStr)
+  Defect_Operator(Simulation <T,D> & sim, const Defect_Description<T> & d, unsigned n_defect) : number(n_defect), r(sim.r), simul(sim), position(sim.r.NStr)
   {
     debug_message("Entered Defect_Operator\n");
     
-    std::string field = defect + std::string("/Concentration");
-    get_hdf5<double> ( &p, file, field );
-    std::vector<unsigned> tmpU;
-    std::vector<int> tmpI;
-    int n;
+    p = d.concentration;
     
-    /* Read Number of nodes and their relative  positions */
-    field = defect + std::string("/NumNodes");
-    get_hdf5<unsigned> ( &NumberNodes, file, field );
-    tmpU.resize(NumberNodes);
-    field = defect + std::string("/NodePosition");
-    get_hdf5<unsigned> ( tmpU.data(), file, field );
-    node_position.resize(NumberNodes);
-    for(unsigned i = 0; i < NumberNodes; i++)
-      node_position.at(i) = tmpU.at(i);
+    /* Nodes and their relative  positions */
+    NumberNodes = d.node_position.size();
+    node_position.assign(d.node_position.begin(), d.node_position.end());
     
+    /* Hoppings */
+    element1.assign(d.node_to.begin(), d.node_to.end());
+    element2.assign(d.node_from.begin(), d.node_from.end());
+    hopping = d.hopping;
     
-    /* Read Hoppings */
-    
-    field = defect + std::string("/NumBondDisorder");
-    get_hdf5<int> ( &n, file, field );
-    
-    tmpI.resize(n);
-    hopping.resize(n);
-    element1.resize(n);
-    element2.resize(n);
-    
-    field = defect + std::string("/NodeTo");
-    get_hdf5<int> (tmpI.data(), file, field );
-    for(int i = 0; i < n; i++)
-      element1.at(i) = tmpI.at(i);
-    
-    field = defect + std::string("/NodeFrom");
-    get_hdf5<int> (tmpI.data(), file, field );
-    for(int i = 0; i < n; i++)
-      element2.at(i) = tmpI.at(i);
-    
-    field = defect + std::string("/Hopping");
-    get_hdf5<T> (hopping.data(), file, field );
-    
-    
-    /* Read local Disorder */
-    
-    field = defect + std::string("/NumOnsiteDisorder");
-    get_hdf5<int> ( &n, file, field );
-    tmpI.resize(n);     
-    U.resize(n);
-    element.resize(n);
-    
-    field = defect + std::string("/NodeOnsite");
-    get_hdf5<int> (tmpI.data(), file, field );
-    for(int i = 0; i < n; i++)
-      element.at(i) = tmpI.at(i);
-    
-    field = defect + std::string("/U0");
-    get_hdf5<T> (U.data(), file, field );
+    /* Local Disorder */
+    element.assign(d.node_onsite.begin(), d.node_onsite.end());
+    U = d.U;
     
     /* Translate Positions */
     unsigned l[D + 1];
@@ -113,15 +72,16 @@ struct Defect_Operator  {
     Eigen::Map<Eigen::Matrix<std::ptrdiff_t,D, 1>> va(Lda.coord), vb(Ldb.coord), Vta(Lta.coord) ; // Column vector
     Eigen::Matrix<double, D, 1> dif_R, dif_O, sum_O, ra;
     Eigen::Matrix<double, D, D> matA = r.rLat.inverse().transpose() * r.ghost_pot * r.rLat.inverse();
-    new_hopping = Eigen::Matrix<T, Eigen::Dynamic,Eigen::Dynamic>::Zero(hopping.size(), r.Ld[D - 1]);
+    // The ghost correlation potential only couples the x component of the hopping with the y coordinate
+    new_hopping = Eigen::Matrix<T, Eigen::Dynamic,Eigen::Dynamic>::Zero(hopping.size(), r.Ld[1]);
     
     
     for(unsigned ih = 0; ih < hopping.size(); ih++)
       {
 	double phase1 = 0., phase2 = 0., phase3 = 0.;
-	for(std::size_t iv = NGHOSTS; iv < r.Ld[D - 1] - NGHOSTS; iv++)
+	for(std::size_t iv = r.nghosts; iv < r.Ld[1] - r.nghosts; iv++)
 	  {
-	    std::size_t ip = NGHOSTS + iv *Lda.basis[D - 1];
+	    std::size_t ip = r.nghosts + iv *Lda.basis[1];
 	    Lda.set_coord(static_cast<std::ptrdiff_t>( ip + node_position[element1.at(ih)]));
 	    Ldb.set_coord(static_cast<std::ptrdiff_t>( ip + node_position[element2.at(ih)]));
 	    dif_R = r.rLat * (va - vb).template cast<double>();
@@ -144,6 +104,16 @@ struct Defect_Operator  {
 
 
   
+  unsigned neighbour_slot(Coordinates<std::size_t,D + 1> & Latt)
+  {
+    // Outbox of the neighbour that owns the ghost Latt: along each direction 0 is the domain
+    // below, 1 this one and 2 the domain above
+    unsigned slot = 0;
+    for(unsigned d = D; d-- > 0; )
+      slot = 3 * slot + (Latt.coord[d] < r.nghosts ? 0 : (Latt.coord[d] >= r.Ld[d] - r.nghosts ? 2 : 1));
+    return slot;
+  }
+  
   void generate_disorder()  {
     debug_message("Entered generate_disorder\n");
     /* Structural disorder*/
@@ -161,34 +131,37 @@ struct Defect_Operator  {
     for(std::size_t istr = 0; istr < r.NStr; istr++)
       position.at(istr).clear();
     
-#pragma omp master
-    {
-      simul.Global.element1.clear();
-      simul.Global.element2_diff.clear();
-      simul.Global.hopping.clear();
-      simul.Global.element.clear();
-      simul.Global.U.clear();
-    }
-#pragma omp barrier
+    /*
+      The bonds and energies of the defects that fall in the ghosts are sent to the neighbour
+      domains. Each thread has an outbox for each of its 3^D neighbours, which only it writes
+      and only that neighbour reads, so no locks are needed. The neighbours finished reading
+      the outboxes at the barrier that ends the previous call
+    */
+    const unsigned neighbours = unsigned(std::pow(3, D));
+    Border_Defects<T> * outbox = &simul.Global.outbox.at(r.thread_id * neighbours);
+    for(unsigned slot = 0; slot < neighbours; slot++)
+      outbox[slot].clear();
 
     Coordinates<std::size_t,D + 1> latt(r.ld), LATT(r.Lt), Latt(r.Ld), Latt2(r.Ld), latStr(r.lStr);
-    // Distribute the local disorder
+    // Distribute the local disorder. Each site of the domain holds a defect with the
+    // probability given by the concentration, drawn from its global index. The numbers
+    // of a whole row are drawn together
 
-    std::size_t ndefects= p * r.N , count = 0;
-    
-    while(count < ndefects) 
+    const std::uint64_t stream = simul.rnd.stream(DEFECTS, number);
+    std::vector<double> u(r.ld[0]);
+    for(std::size_t row = 0; row < r.N; row += r.ld[0])
       {
-	std::size_t  pos = r.N * simul.rnd.get();
-	latt.set_coord(pos);
-	r.convertCoordinates(Latt,latt);
-	r.convertCoordinates(latStr,latt);
-	auto & st = position.at(latStr.index);
-
-	if( !any_of(st.begin(), st.end(), std::bind2nd(std::equal_to<std::size_t>(), Latt.index)))
-	  {	    
-	    st.push_back(Latt.index);
-	    count++;
-	  }
+	latt.set_coord(row);
+	r.convertCoordinates(LATT,latt);
+	simul.rnd.get_row(LATT.index, stream, r.ld[0], u.data());
+	for(std::size_t pos = row; pos < row + r.ld[0]; pos++)
+	  if(u[pos - row] < p)
+	    {
+	      latt.set_coord(pos);
+	      r.convertCoordinates(Latt,latt);
+	      r.convertCoordinates(latStr,latt);
+	      position.at(latStr.index).push_back(Latt.index);
+	    }
       }
     
     // Test if any of the defect cross the borders
@@ -209,46 +182,42 @@ struct Defect_Operator  {
 
 		r.convertCoordinates(latStr, Latt);
 		if(latStr.index < istr)                           
-		  simul.h.hV.add_conflict_with_defect(std::size_t(node_pos), latStr.index);
+		  simul.h.hV.add_conflict_with_defect(std::size_t(node_pos));
 	      }
 	    else
 	      {
 		// node is in the ghosts
 		r.convertCoordinates(LATT, Latt);
-#pragma omp critical
-		{
-		  /*
-		    For the nodes of the defects outside the sample
-		    I need to add the local terms and bonds of the Hamiltonian 
-		    do the global memory to be passed to the neighbour domain
-
-		    In the case of bonds, I will test if the pair corresponds to 
-		    a vacancy in this domain. In this case, the bond will not be added.
-		    
-		  */
-		  
-		  for(unsigned i = 0; i < element1.size(); i++)
-		    if(node == element1[i])
-		      {
-			std::ptrdiff_t  dd =  node_position.at(element2[i]) - node_position.at(element1[i]);
-			auto node2_pos =  *it + node_position.at(element2[i]);
-			Latt2.set_coord(node2_pos);
-			
-			if(r.test_ghosts(Latt2) == 1)
-			  {
-			    // Not in the ghosts
-			    if( simul.h.hV.test_vacancy(Latt2) == 0)  // Not a Vacancy
-			      simul.Global.addbond(LATT.index,  dd, hopping[i]);
-			  }
-			else
-			  simul.Global.addbond(LATT.index,  dd, hopping[i]); // If both nodes are the ghosts I add it
-		      }
-		  
+		Border_Defects<T> & box = outbox[neighbour_slot(Latt)];
+		/*
+		  For the nodes of the defects outside the sample
+		  I need to add the local terms and bonds of the Hamiltonian 
+		  to the outbox of the neighbour domain
 		  
-		  for(unsigned i = 0; i < element.size(); i++)
-		    if(node == element[i])
-		      simul.Global.addlocal(LATT.index, U[i]);
-		}
+		  In the case of bonds, I will test if the pair corresponds to 
+		  a vacancy in this domain. In this case, the bond will not be added.
+		*/
+		
+		for(unsigned i = 0; i < element1.size(); i++)
+		  if(node == element1[i])
+		    {
+		      std::ptrdiff_t  dd =  node_position.at(element2[i]) - node_position.at(element1[i]);
+		      auto node2_pos =  *it + node_position.at(element2[i]);
+		      Latt2.set_coord(node2_pos);
+		      
+		      if(r.test_ghosts(Latt2) == 1)
+			{
+			  // Not in the ghosts
+			  if( simul.h.hV.test_vacancy(Latt2) == 0)  // Not a Vacancy
+			    box.addbond(LATT.index,  dd, hopping[i]);
+			}
+		      else
+			box.addbond(LATT.index,  dd, hopping[i]); // If both nodes are the ghosts I add it
+		    }
+		
+		for(unsigned i = 0; i < element.size(); i++)
+		  if(node == element[i])
+		    box.addlocal(LATT.index, U[i]);
 	      }
 	  }
 #pragma omp barrier
@@ -258,50 +227,39 @@ struct Defect_Operator  {
     */
     
     
-#pragma omp critical
     {
-      Coordinates<std::ptrdiff_t, D + 1> latt(r.ld), LATT(r.Lt), Latt(r.Ld), Ldb(r.Ld), latStr(r.lStr);
-      Eigen::Map<Eigen::Matrix<std::ptrdiff_t,D, 1>> va(Latt.coord), vb(Ldb.coord); // Column vector
-      
-      
-		  
-      Eigen::Matrix<double, D, 1> dr_R;
-      Eigen::Matrix<double, D, 1> dr_a;
-      Eigen::Matrix<double, D, 1> orbital_difference_R;
-      Eigen::Matrix<double, D, 1> lattice_difference_R;
-      Eigen::Matrix<double, D, 1> orbital_difference_a;
-      Eigen::Matrix<double, D, 1> lattice_difference_a;
-      
-      for(unsigned i = 0; i < simul.Global.element1.size(); i++ )
-	if(r.domain_number( long(simul.Global.element1[i]) ) == std::ptrdiff_t(r.thread_id))
-	  {
-	    LATT.set_coord(simul.Global.element1[i]);
-	    r.convertCoordinates(Latt, LATT);
-	    r.convertCoordinates(latStr, Latt);
-	    
-	    auto & st = simul.h.hV.position.at(latStr.index); 
-	    if( !any_of(st.begin(), st.end(), std::bind2nd(std::equal_to<std::size_t>(), Latt.index)))
-	      {     
-		border_element1.push_back( Latt.index );	    
-		border_element2.push_back(Latt.index + simul.Global.element2_diff[i]);
-		border_hopping.push_back(simul.Global.hopping[i]);
-		
-	      }
-	  }
-      
-      for(unsigned i = 0; i < simul.Global.element.size(); i++ )
-	if(r.domain_number (std::ptrdiff_t(simul.Global.element[i])) == std::ptrdiff_t(r.thread_id))
-	  {
-	    LATT.set_coord(simul.Global.element[i] );
-	    r.convertCoordinates(Latt, LATT );
-	    r.convertCoordinates(latStr, Latt);
-	    auto & st = simul.h.hV.position.at(latStr.index); 
-	    if( !any_of(st.begin(), st.end(), std::bind2nd(std::equal_to<std::size_t>(), Latt.index)))
-	      {
-		border_element.push_back(Latt.index );	    
-		border_U.push_back(simul.Global.U[i] );
-	      }
-	  }
+      // The thread reads, from each neighbour, the outbox of the slot that points to this domain
+      Coordinates<std::ptrdiff_t, D + 1> LATT(r.Lt), Latt(r.Ld), xd(std::ptrdiff_t(r.thread_id), r.nd), xs(r.nd);
+      for(unsigned slot = 0; slot < neighbours; slot++)
+	{
+	  for(unsigned d = 0, s = slot; d < D; d++, s /= 3)
+	    xs.coord[d] = (xd.coord[d] - std::ptrdiff_t(s % 3) + 1 + r.nd[d]) % r.nd[d];
+	  xs.coord[D] = 0;
+	  const Border_Defects<T> & box = simul.Global.outbox.at(xs.set_index(xs.coord).index * neighbours + slot);
+	  
+	  for(unsigned i = 0; i < box.element1.size(); i++ )
+	    {
+	      LATT.set_coord(box.element1[i]);
+	      r.convertCoordinates(Latt, LATT);
+	      if(!simul.h.hV.vacant[Latt.index])
+		{     
+		  border_element1.push_back( Latt.index );	    
+		  border_element2.push_back(Latt.index + box.element2_diff[i]);
+		  border_hopping.push_back(box.hopping[i] * border_phase(border_element1.back(), border_element2.back()));
+		}
+	    }
+	  
+	  for(unsigned i = 0; i < box.element.size(); i++ )
+	    {
+	      LATT.set_coord(box.element[i] );
+	      r.convertCoordinates(Latt, LATT );
+	      if(!simul.h.hV.vacant[Latt.index])
+		{
+		  border_element.push_back(Latt.index );	    
+		  border_U.push_back(box.U[i] );
+		}
+	    }
+	}
     }
 #pragma omp barrier
 
@@ -342,67 +300,70 @@ struct Defect_Operator  {
   }
   
   template <unsigned MULT, bool VELOCITY>
-  void multiply_defect(std::size_t istr, T* & phi0, T* & phiM1, unsigned axis)
+  void multiply_defect(std::size_t istr, T* & phi0, T* & phiM1, unsigned axis, unsigned nvec, const SimdKernels<T> & kernel)
   {
     Coordinates<std::ptrdiff_t, D + 1>  local1(r.Ld);
 
     for(std::size_t i = 0; i <  position.at(istr).size(); i++)
       {
 	std::size_t ip = position.at(istr)[i];
-	std::size_t iv = local1.set_coord(ip).coord[D - 1];
+	std::size_t iv = local1.set_coord(ip).coord[1];
 	for(unsigned k = 0; k < hopping.size(); k++)
 	  {
-	    std::size_t k1 = ip + node_position[element1[k]];
-	    std::size_t k2 = ip + node_position[element2[k]];
-
-
-  
+	    std::size_t k1 = (ip + node_position[element1[k]]) * nvec;
+	    std::size_t k2 = (ip + node_position[element2[k]]) * nvec;
+	    T t1 = value_type(MULT + 1) * new_hopping(k, iv);
+	    
 	    if(VELOCITY)
-	      phi0[k1] += value_type(MULT + 1) * v.at(axis).at(k)*new_hopping(k, iv) * phiM1[k2] ;
-	    else
-	    phi0[k1] += value_type(MULT + 1) * new_hopping(k, iv) * phiM1[k2] ;
-	  }
-
-	if(!VELOCITY)
-	for(std::size_t k = 0; k < U.size(); k++)
-	  {
-	    std::size_t k1 = ip + node_position[element[k]];
-	    phi0[k1] += value_type(MULT + 1) * U[k] * phiM1[k1];
+	      t1 *= v.at(axis).at(k);
+	    kernel.axpy(phi0, phiM1, k1, std::ptrdiff_t(k2) - std::ptrdiff_t(k1), t1, nvec);
 	  }
       }
   }
 
-  template <unsigned MULT, bool VELOCITY>
-  void multiply_broken_defect(T* & phi0, T* & phiM1, unsigned axis)
+  T border_phase(std::size_t i1, std::size_t i2)
   {
+    // Ghost correlation of the hopping from i2 to i1, found once for each disorder realization
     Coordinates<std::ptrdiff_t, D + 1> global1(r.Lt), global2(r.Lt), local1(r.Ld) ;
     Eigen::Map<Eigen::Matrix<std::ptrdiff_t,2,1>> v_global1(global1.coord), v_global2(global2.coord);
-    double phase;
-
     Eigen::Matrix<double, 1, 2> temp_vect;
+    
+    r.convertCoordinates(global1, local1.set_coord(i1));
+    r.convertCoordinates(global2, local1.set_coord(i2));
+    temp_vect  = (v_global2 - v_global1).template cast<double>().matrix().transpose();
+    double phase = temp_vect(0)*r.ghost_pot(0,1)*v_global1(1);
+    return simul.h.ghosts_correlation(phase);
+  }
+
+  template <unsigned MULT, bool VELOCITY>
+  void multiply_broken_defect(T* & phi0, T* & phiM1, unsigned axis, unsigned nvec, const SimdKernels<T> & kernel)
+  {
+    // The phases of the ghost correlation are already in border_hopping
     for(std::size_t i = 0; i < border_element1.size(); i++)
       {
 	std::size_t i1 = border_element1[i];
 	std::size_t i2 = border_element2[i];
 	
-	// These four lines pertrain only to the ghost_correlation
-	r.convertCoordinates(global1, local1.set_coord(i1));
-	r.convertCoordinates(global2, local1.set_coord(i2));
-	temp_vect  = (v_global2 - v_global1).template cast<double>().matrix().transpose();
-	phase = temp_vect(0)*r.ghost_pot(0,1)*v_global1(1); //.template cast<double>().matrix();
-	
+	T t1 = value_type(MULT + 1) * border_hopping[i];
 	if(VELOCITY)
-	  phi0[i1] += value_type(MULT + 1) * border_v.at(axis).at(i) * border_hopping[i] * phiM1[i2] * simul.h.ghosts_correlation(phase);
-	else
-	phi0[i1] += value_type(MULT + 1) * border_hopping[i] * phiM1[i2] * simul.h.ghosts_correlation(phase);
+	  t1 *= border_v.at(axis).at(i);
+	kernel.axpy(phi0, phiM1, i1 * nvec, std::ptrdiff_t(i2 * nvec) - std::ptrdiff_t(i1 * nvec), t1, nvec);
       }
+  }
+  
+  void add_onsite_energies(std::vector<value_type> & diagonal)
+  {
+    /*
+      The local energies of the defects, and of the defects of the neighbouring
+      domains that reach this one, are added to the on-site energies of the Hamiltonian
+    */
+    for(std::size_t istr = 0; istr < r.NStr; istr++)
+      for(auto ip = position.at(istr).begin(); ip != position.at(istr).end(); ip++)
+	for(std::size_t k = 0; k < U.size(); k++)
+	  diagonal.at(*ip + node_position[element[k]]) += std::real(U[k]);
     
-    if(!VELOCITY)
     for(std::size_t i = 0; i < border_element.size(); i++)
-      {
-	std::size_t i1 = border_element[i];
-	phi0[i1] += value_type(MULT + 1) * border_U[i] * phiM1[i1];
-      }
+      diagonal.at(border_element[i]) += std::real(border_U[i]);
   }
   void build_velocity(std::vector<unsigned> & components, unsigned n)
   {
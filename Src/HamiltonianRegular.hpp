@@ -19,29 +19,19 @@ struct Periodic_Operator {
   Eigen::Array<   T, Eigen::Dynamic, Eigen::Dynamic> hopping;                 // Hopping
   std::vector<Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>>        v;
   Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic> dist; 
+  Eigen::Array<   T, Eigen::Dynamic, Eigen::Dynamic> row_hopping;             // Hoppings with the phase of each row of the domain
+  std::vector<Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>>  row_velocity; // The same for each velocity
   Periodic_Operator(Simulation<T,D> & sim) : simul(sim) {
     debug_message("Entered Periodic_Operator constructor.\n");
     
-    NHoppings =  Eigen::Array<unsigned, Eigen::Dynamic, 1 > (sim.r.Orb);
-#pragma omp critical
-    {
-      H5::H5File *file = new H5::H5File(sim.name, H5F_ACC_RDONLY);
-      get_hdf5<unsigned>(NHoppings.data(), file, (char *) "/Hamiltonian/NHoppings");
-
-      std::size_t max  	= NHoppings.maxCoeff();
-      distance 			= Eigen::Matrix< std::ptrdiff_t, Eigen::Dynamic, Eigen::Dynamic>  (max, sim.r.Orb);
-      dist 				= Eigen::Matrix< int, Eigen::Dynamic, Eigen::Dynamic>  (max, sim.r.Orb);
-      hopping  		= Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>(max, sim.r.Orb);
-
-      get_hdf5<T>(hopping.data(), file, (char *) "/Hamiltonian/Hoppings");          // Read Hoppings
-      get_hdf5<int>(dist.data(), file, (char *) "/Hamiltonian/d");                  // Read the distances
-      
-      for(std::size_t i = 0; i < max; i++ )
-	for(std::size_t j = 0; j <  sim.r.Orb; j++ )      
-	  distance(i,j) = dist(i,j);
-      delete file;
-      Convert_Build(sim.r);
-    }
+    // The hoppings of the configuration are converted into the distances in the domain of this thread
+    const Configuration<T,D> & config = sim.config;
+    NHoppings = config.NHoppings;
+    hopping   = config.hopping;
+    dist      = config.distance;
+    distance  = dist.template cast<std::ptrdiff_t>().array();
+    Convert_Build(sim.r);
+    build_row_hoppings(row_hopping, hopping);
     debug_message("Left Periodic_Operator constructor.\n");
   }
 
@@ -136,7 +126,41 @@ struct Periodic_Operator {
 	      v1(ih,io) *= value_type(dr_R(components.at(i)));
 	  }
       }
+    
+    if(n == row_velocity.size())
+      row_velocity.push_back(Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>());
+    build_row_hoppings(row_velocity.at(n), hopping * v1);
   }	  
+  
+  void build_row_hoppings(Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> & table, const Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> & coefficients)
+  {
+    /*
+      The ghost correlation potential only couples the a[0] component of the hopping with
+      the a[1] coordinate, so the phases only change from row to row. They are found once,
+      and the coefficients of the row i1 of the domain are in the columns i1 * Orb + io
+    */
+    LatticeStructure<D> & r = simul.r;
+    Coordinates<std::ptrdiff_t, D + 1> global(r.Lt), local(r.Ld);
+    unsigned l[D + 1];
+    std::fill_n(l, D, 3);
+    l[D]  = r.Orb;
+    Coordinates<std::ptrdiff_t, D + 1> b3(l);
+    Eigen::Map<Eigen::Matrix<std::ptrdiff_t,D, 1>> vee(b3.coord); // Column vector
+    
+    table.resize(coefficients.rows(), r.Orb * r.Ld[1]);
+    for(std::size_t i1 = 0; i1 < r.Ld[1]; i1++)
+      {
+	r.convertCoordinates(global, local.set_coord(std::ptrdiff_t(i1) * local.basis[1]));
+	for(unsigned io = 0; io < r.Orb; io++)
+	  for(unsigned ib = 0; ib < NHoppings(io); ib++)
+	    {
+	      b3.set_coord(dist(ib,io));
+	      vee.array() -= 1;
+	      value_type phase = (D > 1 ? vee(0)*global.coord[1]*r.ghost_pot(0,1) : 0);
+	      table(ib, i1 * r.Orb + io) = coefficients(ib, io) * ghosts_correlation1(phase);
+	    }
+      }
+  }
 	
   template <typename U = T>
   typename std::enable_if<is_tt<std::complex, U>::value, U>::type ghosts_correlation1(double phase) {
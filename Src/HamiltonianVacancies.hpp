@@ -14,6 +14,7 @@ struct Vacancy_Operator {
   std::vector <double>                   concentration;
   std::vector <std::vector<int>>         orbitals;
   std::vector <std::size_t>              vacancies_with_defects; 
+  std::vector <bool>                     vacant;                     // True in the vacant sites of the domain
   
   Vacancy_Operator(Simulation <T,D> & sim) : r(sim.r), simul(sim), position(sim.r.NStr)
   {
@@ -31,28 +32,38 @@ struct Vacancy_Operator {
     for(unsigned i = 0; i < r.NStr ; i++)
       position.at(i).clear();
     vacancies_with_defects.clear();
-    // Distribute Vacancies
+    vacant.assign(r.Sized, false);
+    // Distribute Vacancies. Each site of the domain is a vacancy with the probability
+    // given by the concentration, drawn from its global index. The numbers of a whole
+    // row are drawn together, and the sites already vacant are found in the bitset
     
+    Coordinates<std::size_t,D + 1> LATT(r.Lt);
+    std::vector<double> u(r.ld[0]);
     for(unsigned k = 0; k < concentration.size(); k++)
       {
-	std::size_t vacancies_number =  concentration[k]*r.N, count = 0;
-	while(count < vacancies_number)
+	const std::uint64_t stream = simul.rnd.stream(VACANCIES, k);
+	for(std::size_t row = 0; row < r.N; row += r.ld[0])
 	  {
-	    std::size_t i = simul.rnd.get()*r.N;
-	    latt.set_coord(i + orbitals.at(k).at(0) * r.N );
-	    r.convertCoordinates(latStr,latt);                  // Get stride position
-	    r.convertCoordinates(Latt,latt);                    // Get Domain coordinates
-	    auto & pos = position.at(latStr.index);
-	    if(!any_of(pos.begin(), pos.end(), std::bind2nd(std::equal_to<std::size_t>(), Latt.index )))
-	      {
-		for(auto o = orbitals.at(k).begin(); o != orbitals.at(k).end(); o++)
-		  {
-		    latt.set_coord(i + std::size_t(*o) * r.N);
-		    r.convertCoordinates(Latt,latt);
-		    pos.push_back(Latt.index);
-		  }
-		count++;
-	      }
+	    latt.set_coord(row + orbitals.at(k).at(0) * r.N );
+	    r.convertCoordinates(LATT,latt);
+	    simul.rnd.get_row(LATT.index, stream, r.ld[0], u.data());
+	    for(std::size_t i = row; i < row + r.ld[0]; i++)
+	      if(u[i - row] < concentration[k])
+		{
+		  latt.set_coord(i + orbitals.at(k).at(0) * r.N );
+		  r.convertCoordinates(latStr,latt);                  // Get stride position
+		  r.convertCoordinates(Latt,latt);                    // Get Domain coordinates
+		  if(vacant[Latt.index])
+		    continue;
+		  auto & pos = position.at(latStr.index);
+		  for(auto o = orbitals.at(k).begin(); o != orbitals.at(k).end(); o++)
+		    {
+		      latt.set_coord(i + std::size_t(*o) * r.N);
+		      r.convertCoordinates(Latt,latt);
+		      pos.push_back(Latt.index);
+		      vacant[Latt.index] = true;
+		    }
+		}
 	  }
       }
     
@@ -65,15 +76,14 @@ struct Vacancy_Operator {
   {
     orbitals.push_back(orb);
     concentration.push_back(p);
+    // Mean number of vacant sites
     r.SizetVacancies += std::size_t(p * r.Nt * orb.size());    
   }
   
-  void add_conflict_with_defect(std::size_t element, unsigned istride)
+  void add_conflict_with_defect(std::size_t element)
   {
-    std::vector<std::size_t> & v = position.at(istride);  
-    for(unsigned i = 0; i < v.size(); i++)
-      if(element == v.at(i))
-	vacancies_with_defects.push_back(element);
+    if(vacant[element])
+      vacancies_with_defects.push_back(element);
   }
   
   bool test_vacancy(Coordinates<std::size_t,D + 1> & Latt)
@@ -82,13 +92,7 @@ struct Vacancy_Operator {
       1 if is a vacancy
       0 if not
     */
-    Coordinates<std::size_t,D + 1> latStr(r.lStr);
-    r.convertCoordinates(latStr, Latt);
-    auto & vc = position.at(latStr.index);
-    if( !any_of(vc.begin(), vc.end(), std::bind2nd(std::equal_to<std::size_t>(), Latt.index)))
-      return 0;
-    else
-      return 1;
+    return vacant[Latt.index];
   }
 
   void test_field( T * phi0 )
@@ -10,21 +10,190 @@ class KPM_VectorBasis {
 protected:
   int index;
   const int memory;
+  const unsigned nvec;   // Number of random vectors stored interleaved in each column (block recursion)
   Simulation<T,D> & simul;
-  
+  SimdKernels<T> kernel; // Kernels acting on the columns, aware of the storage layout of the complex vectors
   
 public:
-  Eigen::Matrix <T, Eigen::Dynamic,  Eigen::Dynamic > v;
-  KPM_VectorBasis(int mem,  Simulation<T,D> & sim) :
-    memory(mem), simul(sim) {
+  typedef typename extract_value_type<T>::value_type value_type;
+  typedef typename accumulate_type<T>::type accumulate;  // Type of the products between vectors
+  typedef typename extract_value_type<accumulate>::value_type accumulate_value;
+  /*
+    With SPLIT_COMPLEX the real and imaginary parts of each column of a complex v are stored
+    in two consecutive planes, so its elements must be accessed with get_value and set_value.
+    Copies of columns and products by real numbers do not depend on the layout.
+  */
+  // The columns are stored in a block of the arena of the thread, reused by the following measurements
+  Eigen::Map<Eigen::Matrix <T, Eigen::Dynamic,  Eigen::Dynamic >> v;
+  KPM_VectorBasis(int mem,  Simulation<T,D> & sim, unsigned nv = 1) :
+    memory(mem), nvec(nv), simul(sim), kernel(simul.r.Sized * nv),
+    v(sim.arena.allocate(simul.r.Sized * nv * mem), simul.r.Sized * nv, mem) {
     index  = 0;
-    v = Eigen::Matrix <T, Eigen::Dynamic,  Eigen::Dynamic >::Zero(simul.r.Sized, memory);
+    v.setZero();
+  };
+  
+  KPM_VectorBasis(const KPM_VectorBasis &) = delete;
+  
+  ~KPM_VectorBasis() {
+    simul.arena.release(v.data());
   };
   
   void set_index(int i) {index = i;};
   void inc_index() {index = (index + 1) % memory;};  
   unsigned get_index(){return index;};
-
+  unsigned get_nvec(){return nvec;};
+  
+  T get_value(std::size_t e, int col) { return kernel.get(v.col(col).data(), e); };
+  void set_value(std::size_t e, int col, T val) { kernel.set(v.col(col).data(), e, val); };
+  
+  // Matrix of the products <this_i|w_j> between the columns of the two vectors: v.adjoint() * w.v
+  template <typename U = T>
+  typename std::enable_if<!split_layout<U>::value, Eigen::Matrix<accumulate, -1, -1>>::type adjoint_product(KPM_VectorBasis<T,D> & w) {
+    return product_in<accumulate>(v, w.v);
+  };
+  
+  template <typename U = T>
+  typename std::enable_if<split_layout<U>::value, Eigen::Matrix<accumulate, -1, -1>>::type adjoint_product(KPM_VectorBasis<T,D> & w) {
+    // Seen as real matrices, the columns 2i and 2i + 1 are the real and imaginary planes of the column i
+    Eigen::Map<Eigen::Matrix<value_type, -1, -1>> a(reinterpret_cast<value_type *>(v.data()), v.rows(), 2 * v.cols());
+    Eigen::Map<Eigen::Matrix<value_type, -1, -1>> b(reinterpret_cast<value_type *>(w.v.data()), w.v.rows(), 2 * w.v.cols());
+    Eigen::Matrix<accumulate_value, -1, -1> p = product_in<accumulate_value>(a, b);
+    Eigen::Matrix<accumulate, -1, -1> c(v.cols(), w.v.cols());
+    for(long i = 0; i < v.cols(); i++)
+      for(long j = 0; j < w.v.cols(); j++)
+	c(i, j) = accumulate(p(2*i, 2*j) + p(2*i + 1, 2*j + 1), p(2*i, 2*j + 1) - p(2*i + 1, 2*j));
+    return c;
+  };
+  
+  template <typename S, typename M>
+  static Eigen::Matrix<S, -1, -1> product_in(const M & a, const M & b) {
+    /*
+      a.adjoint() * b summed in the type S. When S is wider than the type of the vectors,
+      the rows are converted in blocks that stay in cache, instead of copying whole vectors
+    */
+    typedef typename M::Scalar U;
+    if(std::is_same<S, U>::value)
+      return (a.adjoint() * b).template cast<S>();
+    
+    const long block = 4096;
+    Eigen::Matrix<S, -1, -1> c = Eigen::Matrix<S, -1, -1>::Zero(a.cols(), b.cols());
+    for(long i = 0; i < a.rows(); i += block)
+      {
+	const long n = std::min(block, long(a.rows()) - i);
+	c += a.middleRows(i, n).template cast<S>().adjoint() * b.middleRows(i, n).template cast<S>();
+      }
+    return c;
+  };
+  
+  // Product <a|b> between the columns a and b restricted to the sub-domain, the ghosts are left out
+  accumulate interior_product(int a, int b) {
+    LatticeStructure<D> & r = simul.r;
+    const std::size_t n = std::size_t(r.ld[0]) * nvec; // Length of the rows without the ghosts
+    std::size_t rows = r.Orb;
+    for(unsigned d = 1; d < D; d++)
+      rows *= r.ld[d];
+    
+    Coordinates<std::size_t, D + 1> x(r.Ld);
+    accumulate sum = 0.;
+    for(std::size_t row = 0; row < rows; row++)
+      {
+	std::size_t c = row, k = r.nghosts * x.basis[0];
+	for(unsigned d = 1; d < D; d++)
+	  {
+	    k += (r.nghosts + c % r.ld[d]) * x.basis[d];
+	    c /= r.ld[d];
+	  }
+	k += c * x.basis[D];
+	sum += kernel.dot(v.col(a).data(), v.col(b).data(), k * nvec, n);
+      }
+    return sum;
+  };
+  
+  /*
+    The ghosts are exchanged with point-to-point synchronization. A thread sends its faces
+    perpendicular to d by raising its flag, and before reading the faces of a neighbour it
+    only waits for the flag of that neighbour.
+    With DIRECT_GHOSTS the neighbours read the faces straight from the column of the vector,
+    and the exchange only ends when both of them have read the faces along every direction,
+    so that the column can be changed again.
+    Otherwise the faces are copied to the buffers of the thread in Global.ghosts. The buffers
+    alternate between consecutive exchanges, so the faces being sent never overwrite the
+    ones a slower neighbour is still reading
+  */
+  std::size_t & exchange_flag(std::size_t thread, unsigned d) {
+    return simul.Global.exchange_flags[(thread * D + d) * simul.Global.flag_stride];
+  };
+  
+  void wait_counter(std::size_t & counter, std::size_t value) {
+    std::size_t current;
+    while(true)
+      {
+#pragma omp atomic read
+	current = counter;
+	if(current >= value)
+	  break;
+	std::this_thread::yield();
+      }
+#pragma omp flush
+  };
+  
+  void raise_flag(unsigned d) {
+    std::size_t & flag = exchange_flag(simul.r.thread_id, d);
+    const std::size_t step = flag + 1;
+#pragma omp flush
+#pragma omp atomic write
+    flag = step;
+  };
+  
+#if DIRECT_GHOSTS
+  std::size_t & exchange_ack(std::size_t thread, unsigned d) {
+    return simul.Global.exchange_acks[(thread * D + d) * simul.Global.flag_stride];
+  };
+  
+  void post_faces(unsigned d) {
+    simul.Global.ghost_columns[simul.r.thread_id * D + d] = v.col(index).data();
+    raise_flag(d);
+  };
+  
+  T * wait_faces(std::size_t thread, unsigned d) {
+    // Waits until the thread has sent its faces of the current exchange along d, and returns its column
+    wait_counter(exchange_flag(thread, d), exchange_flag(simul.r.thread_id, d));
+    return simul.Global.ghost_columns[thread * D + d];
+  };
+  
+  void release_faces(std::size_t thread, unsigned d) {
+    // Tells the thread that its faces along d were read
+#pragma omp flush
+#pragma omp atomic
+    exchange_ack(thread, d)++;
+  };
+  
+  void finish_exchange() {
+    for(unsigned d = 0; d < D; d++)
+      wait_counter(exchange_ack(simul.r.thread_id, d), 2 * exchange_flag(simul.r.thread_id, d));
+  };
+#else
+  T * ghost_buffer(std::size_t thread, unsigned d, std::size_t step) {
+    return & simul.Global.ghosts[thread][(d * 2 + step % 2) * simul.ghosts.size()];
+  };
+  
+  void post_faces(unsigned d, std::size_t size) {
+    // Sends the first size elements of simul.ghosts
+    const std::size_t step = exchange_flag(simul.r.thread_id, d) + 1;
+    std::copy(simul.ghosts.begin(), simul.ghosts.begin() + size, ghost_buffer(simul.r.thread_id, d, step));
+    raise_flag(d);
+  };
+  
+  T * wait_faces(std::size_t thread, unsigned d) {
+    // Waits until the thread has sent its faces of the current exchange along d, and returns them
+    const std::size_t step = exchange_flag(simul.r.thread_id, d);
+    wait_counter(exchange_flag(thread, d), step);
+    return ghost_buffer(thread, d, step);
+  };
+  
+  void finish_exchange() {};
+#endif
+  
   // Define aux_wr for complex T 
   template <typename U = T>
   typename std::enable_if<is_tt<std::complex, U>::value, U>::type aux_wr(std::size_t x ) {
@@ -51,11 +220,12 @@ template <typename T, unsigned D>
 class KPM_Vector : public KPM_VectorBasis <T,D> {
 public:
   typedef typename extract_value_type<T>::value_type value_type;
-  KPM_Vector(int mem, Simulation<T,D> & sim) :
-    KPM_VectorBasis<T,D>(mem,sim){};
+  KPM_Vector(int mem, Simulation<T,D> & sim, unsigned nv = 1) :
+    KPM_VectorBasis<T,D>(mem,sim,nv){};
     
   
   void initiate_vector() {};
+  void initiate_vector(unsigned) {};
   template <unsigned MULT>
   void Multiply(){};
   template <unsigned MULT>
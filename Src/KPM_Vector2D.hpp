@@ -17,7 +17,10 @@ private:
   std::size_t   stride_ghosts[2];
   LatticeStructure<2u>       & r;
   Hamiltonian<T,2u>          & h;
-  T               ***mult_t1_ghost_cor;
+  const T                 *coefficients; // Hoppings of each row of the domain, with their phases
+  std::vector<typename extract_value_type<T>::value_type> row_energy; // On-site energies of a row of a tile
+  typename Stencil<T>::row_type *stencil;
+  std::ptrdiff_t     **stencil_distance;
   Coordinates<std::size_t,3>   x;
   T                        *phi0;
   T                       *phiM1;
@@ -29,21 +32,29 @@ public:
   using KPM_VectorBasis<T,2>::index;
   using KPM_VectorBasis<T,2>::v;
   using KPM_VectorBasis<T,2>::memory;
+  using KPM_VectorBasis<T,2>::nvec;
+  using KPM_VectorBasis<T,2>::kernel;
+  using KPM_VectorBasis<T,2>::get_value;
+  using KPM_VectorBasis<T,2>::set_value;
   using KPM_VectorBasis<T,2>::aux_wr;
   using KPM_VectorBasis<T,2>::aux_test;
   using KPM_VectorBasis<T,2>::inc_index;
   
-  KPM_Vector(int mem, Simulation<T,2> & sim) : KPM_VectorBasis<T,2>(mem, sim), r(sim.r), h(sim.h), x(r.Ld), std(x.basis[1]) {
+  KPM_Vector(int mem, Simulation<T,2> & sim, unsigned nv = 1) : KPM_VectorBasis<T,2>(mem, sim, nv), r(sim.r), h(sim.h), x(r.Ld), std(x.basis[1]) {
     unsigned d;
     Coordinates <std::size_t, 3>     z(r.Ld);
     Coordinates <int, 3> x(r.nd), dist(r.nd);
 
-    mult_t1_ghost_cor = new T**[r.Orb];
+    stencil = new typename Stencil<T>::row_type[r.Orb];
+    stencil_distance = new std::ptrdiff_t*[r.Orb];
+    row_energy.resize(r.stride);
     for(unsigned io = 0; io < r.Orb; io++)
       {
-	mult_t1_ghost_cor[io] = new T*[h.hr.NHoppings(io)];
+	// Specialized kernel for the number of hoppings of this orbital, if there is one
+	stencil[io] = Stencil<T>::select(h.hr.NHoppings(io));
+	stencil_distance[io] = new std::ptrdiff_t[h.hr.NHoppings(io)];
 	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
-	  mult_t1_ghost_cor[io][ib] = new T[STRIDE];
+	  stencil_distance[io][ib] = h.hr.distance(ib, io) * std::ptrdiff_t(nvec);
       }
 
     for(unsigned d = 0; d < 2; d++)
@@ -54,25 +65,29 @@ public:
 	    
 	}
     
+    /*
+      The lines along a[0] are exchanged first, and the lines along a[1] then
+      include the ghosts of the bottom and top, so that the corners are filled
+    */
     for(std::size_t io = 0; io < r.Orb; io++)
       {
 	d = 0;
-	max[d] =  r.ld[1];
+	max[d] =  r.Ld[1];
 	stride[d]  = r.Ld[0];
 	stride_ghosts[d] = 1;
-	MemIndBeg[d][0][io] = z.set({std::size_t(NGHOSTS),               std::size_t(NGHOSTS), io}).index;   // From the index Starting here --- Right
-	MemIndEnd[d][0][io] = z.set({std::size_t(0),                     std::size_t(NGHOSTS), io}).index;   //   To the index Starting here --- Right
-	MemIndBeg[d][1][io] = z.set({std::size_t(r.Ld[0] - 2 * NGHOSTS), std::size_t(NGHOSTS), io}).index;   // From the index Starting here --- Left
-	MemIndEnd[d][1][io] = z.set({std::size_t(r.Ld[0] - NGHOSTS),     std::size_t(NGHOSTS), io}).index;   //   To the index Starting here --- Left
+	MemIndBeg[d][0][io] = z.set({std::size_t(r.nghosts),               std::size_t(0), io}).index;   // From the index Starting here --- Right
+	MemIndEnd[d][0][io] = z.set({std::size_t(0),                     std::size_t(0), io}).index;   //   To the index Starting here --- Right
+	MemIndBeg[d][1][io] = z.set({std::size_t(r.Ld[0] - 2 * r.nghosts), std::size_t(0), io}).index;   // From the index Starting here --- Left
+	MemIndEnd[d][1][io] = z.set({std::size_t(r.Ld[0] - r.nghosts),     std::size_t(0), io}).index;   //   To the index Starting here --- Left
 	
 	d = 1;
-	max[d] =  r.Ld[0];
+	max[d] =  r.ld[0];
 	stride[d] = 1;
 	stride_ghosts[d] = r.Ld[0];
-	MemIndBeg[d][0][io] = z.set({std::size_t(0), std::size_t(NGHOSTS),             io}).index;          // From the index Starting here --- Bottom
-	MemIndEnd[d][0][io] = z.set({std::size_t(0), std::size_t(0),                   io}).index;          //   To the index Starting here --- Bottom
-	MemIndBeg[d][1][io] = z.set({std::size_t(0), std::size_t(r.Ld[1] - 2*NGHOSTS), io}).index;          // From the index Starting here --- Top
-	MemIndEnd[d][1][io] = z.set({std::size_t(0), std::size_t(r.Ld[1] - NGHOSTS),   io}).index;          //   To the index Starting here --- Top
+	MemIndBeg[d][0][io] = z.set({std::size_t(r.nghosts), std::size_t(r.nghosts),             io}).index;          // From the index Starting here --- Bottom
+	MemIndEnd[d][0][io] = z.set({std::size_t(r.nghosts), std::size_t(0),                   io}).index;          //   To the index Starting here --- Bottom
+	MemIndBeg[d][1][io] = z.set({std::size_t(r.nghosts), std::size_t(r.Ld[1] - 2*r.nghosts), io}).index;          // From the index Starting here --- Top
+	MemIndEnd[d][1][io] = z.set({std::size_t(r.nghosts), std::size_t(r.Ld[1] - r.nghosts),   io}).index;          //   To the index Starting here --- Top
       }
     
     for(d = 0 ; d < 2; d++)
@@ -82,7 +97,10 @@ public:
 	  dist.coord[d] = int(b) * 2 - 1;
 	  block[d][b] = x.set_coord( int(r.thread_id) ).add(dist).index;
 	}
+    // The vector starts random, without changing the numbers of the random vectors of the calculations
+    const std::uint64_t vectors = simul.rnd.vectors;
     initiate_vector();
+    simul.rnd.vectors = vectors;
   };
   
   
@@ -96,124 +114,123 @@ public:
 	}
     for(unsigned io = 0; io < r.Orb;io++)
       {	
-	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
-	  delete mult_t1_ghost_cor[io][ib];
-	delete mult_t1_ghost_cor[io];
+	delete [] stencil_distance[io];
       }
-    delete mult_t1_ghost_cor;
+    delete [] stencil_distance;
+    delete [] stencil;
   }
   
   void initiate_vector() {
+    initiate_vector(nvec);
+  };
+  
+  void initiate_vector(unsigned nactive) {
+    /*
+      Only the first nactive vectors of the block are random,
+      the remaining ones are set to zero and do not contribute to the moments
+    */
     index = 0;
-    Coordinates<std::size_t, 3> x(r.Ld);
+    // The random vectors are numbered in the order they are drawn, and each element is
+    // a function of the number of the vector and of the global index of the site
+    const std::uint64_t first = simul.rnd.vectors;
+    simul.rnd.vectors += nactive;
+    const value_type scale = value_type(1) / sqrt(value_type(r.Sizet - r.SizetVacancies));
+    const std::size_t width = r.Ld[0] - 2 * r.nghosts;
+    std::vector<T> row(width);
+    Coordinates<std::ptrdiff_t, 3> x(r.Ld), global(r.Lt);
     for(std::size_t io = 0; io < r.Orb; io++)
-      for(std::size_t i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1++)
-	for(std::size_t i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0++)
-	  v(x.set({i0,i1,io}).index, index) = simul.rnd.init()/static_cast<value_type>(sqrt(value_type(r.Sizet - r.SizetVacancies)));
+      for(std::size_t i1 = r.nghosts; i1 < r.Ld[1] - r.nghosts; i1++)
+	{
+	  // The sites of a row are consecutive in the domain and in the whole lattice
+	  r.convertCoordinates(global, x.set({std::ptrdiff_t(r.nghosts), std::ptrdiff_t(i1), std::ptrdiff_t(io)}));
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    {
+	      if(ir < nactive)
+		simul.rnd.init_row(global.index, first + ir, width, scale, row.data());
+	      else
+		std::fill(row.begin(), row.end(), T(0.));
+	      for(std::size_t i = 0; i < width; i++)
+		set_value((x.index + i) * nvec + ir, index, row[i]);
+	    }
+	}
     
+    // The vacancies are few, so they are zeroed one by one
     for(unsigned i = 0; i < r.NStr; i++)
       {
 	auto & vv = h.hV.position.at(i); 
 	for(unsigned j = 0; j < vv.size(); j++)
-	  v(vv.at(j), index ) = 0. ;
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    set_value(vv.at(j) * nvec + ir, index, T(0.));
       }
     
   };
   
-  template < unsigned MULT,bool VELOCITY> 
-  void build_regular_phases(int i1, unsigned axis)
-  {
-    unsigned l[2 + 1], count;
-    Coordinates<std::ptrdiff_t, 3>  global(r.Lt);
-    Coordinates<std::ptrdiff_t, 3> local1(r.Ld);
-    Coordinates<std::size_t,3> x(r.Ld);
-    std::fill_n(l, 2, 3);
-    l[2]  = r.Orb;
-    Coordinates<std::ptrdiff_t, 2 + 1> b3(l);    
-    Eigen::Map<Eigen::Matrix<std::ptrdiff_t,2, 1>> vee(b3.coord); // Column vector
-    
-    
-    for(unsigned io = 0; io < r.Orb; io++)
-      {
-	const std::size_t ip = io * x.basis[2] ;
-	const std::size_t j0 = ip + 0 + i1 * std;
-	const std::size_t j1 = j0 + STRIDE * std;
-
-	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
-	  {
-	    T tt  = value_type(MULT + 1) * h.hr.hopping(ib, io);
-	    b3.set_coord(h.hr.dist(ib,io));        
-	    vee.array() -= 1;
-	    count = 0;
-	    if (VELOCITY)  tt  *=  h.hr.v.at(axis)(ib,io);
-	    for(std::size_t j = j0; j < j1; j += std )
-	      {
-		r.convertCoordinates(global, local1.set_coord(j));
-		value_type phase = vee(0)*global.coord[1]*r.ghost_pot(0,1);
-		mult_t1_ghost_cor[io][ib][count] =  tt * h.ghosts_correlation(phase);
-		count++;
-	      }
-	  }
-      }
-  }
-    
   template < unsigned MULT> 
   void initiate_stride(std::size_t & istr)
   {
     std::size_t i0, i1;
     const std::size_t std = x.basis[1];
     // Periodic component of the Hamiltonian + Anderson disorder
-    i0 = ((istr) % (r.lStr[0]) ) * STRIDE + NGHOSTS;
-    i1 = ((istr) / r.lStr[0] ) * STRIDE + NGHOSTS;
+    i0 = ((istr) % (r.lStr[0]) ) * r.stride + r.nghosts;
+    i1 = ((istr) / r.lStr[0] ) * r.stride + r.nghosts;
+    const std::size_t width = r.tile_length(0, i0);
 			
     for(std::size_t io = 0; io < r.Orb; io++)
       {
 	const std::size_t ip = io * x.basis[2];
 	const std::size_t j0 = ip + i0 + i1 * std;
-	const std::size_t j1 = j0 + STRIDE * std; //j0 and j1 define the limits of the for cycle
+	const std::size_t j1 = j0 + r.tile_length(1, i1) * std; //j0 and j1 define the limits of the for cycle
 
 
 	for(std::size_t j = j0; j < j1; j += std )
-	  for(std::size_t i = j; i < j + STRIDE ; i++)
-	    phi0[i] = - value_type(MULT) * phiM2[i];
+	  initiate_row<MULT>(j, width);
       }
   }
+  
+  template < unsigned MULT> 
+  void inline initiate_row(const  std::size_t & j, const std::size_t & width)
+  {
+    kernel.scale(phi0, phiM2, j * nvec, - value_type(MULT), width * nvec);
+  }
 				
   template < unsigned MULT> 
-  void inline mult_local_disorder(const  std::size_t & j0, const  std::size_t & io)
+  void inline mult_local_disorder(const  std::size_t & j, const value_type * u, const std::size_t & width)
   {
-    const std::size_t j1 = j0 + STRIDE * std;
-    const std::ptrdiff_t dd = (h.Anderson_orb_address[io] - std::ptrdiff_t(io))*r.Nd;
-    // Anderson disorder
-    if( h.Anderson_orb_address[io] >= 0)
-      {
-	for(std::size_t j = j0; j < j1; j += std )
-	  for(std::size_t i = j; i < j + STRIDE ; i++)
-	    phi0[i] += value_type(MULT + 1) * phiM1[i] * h.U_Anderson.at(i + dd);
-      }
-    else if (h.Anderson_orb_address[io] == - 1)
-      {
-	for(std::size_t j = j0; j < j1; j += std )
-	  for(std::size_t i = j; i < j + STRIDE ; i++)
-	    phi0[i] += value_type(MULT + 1) * phiM1[i] * h.U_Orbital.at(io);
-      }
+    // On-site energies u of the row starting at j, shared by the nvec vectors of the block
+    if(nvec == 1)
+      kernel.axpy_diag(phi0, phiM1, j, u, value_type(MULT + 1), width);
+    else
+      for(std::size_t i = 0; i < width ; i++)
+	kernel.axpy(phi0, phiM1, (j + i) * nvec, 0, T(value_type(MULT + 1) * u[i]), nvec);
   }
-	      
-  void inline mult_regular_hoppings(const  std::size_t & j0, const  std::size_t & io)
+		      
+  template < unsigned MULT, bool VELOCITY>
+  void inline mult_regular_hoppings(const  std::size_t & j, const  std::size_t & io, const std::size_t & i1, const std::size_t & width)
   {
-    std::size_t count;
-    const std::size_t j1 = j0 + STRIDE * std;
-    // Hoppings
-    for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+    /*
+      Hoppings and on-site energies: the nvec vectors of the block share each coefficient and
+      neighbour address. With a single vector the on-site energies are added by the stencil
+    */
+    const T * c = coefficients + (i1 * r.Orb + io) * h.hr.row_hopping.rows();
+    const value_type * u = (!VELOCITY && h.onsite_disorder ? h.onsite_energies(j, width, row_energy.data()) : nullptr);
+    if(stencil[io] != nullptr)
       {
-	const std::ptrdiff_t d1 = h.hr.distance(ib, io);
-	count = 0;
-	for(std::size_t j = j0; j < j1; j += std )
+	T t[STENCIL_MAX_HOPPINGS];
+	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+	  t[ib] = value_type(MULT + 1) * c[ib];
+	if(nvec == 1)
 	  {
-	    const T t1 = mult_t1_ghost_cor[io][ib][count++];
-	    for(std::size_t i = j; i < j + STRIDE ; i++)
-	      phi0[i] += t1 * phiM1[i + d1];								
+	    stencil[io](phi0 + j, phiM1 + j, stencil_distance[io], t, u, value_type(MULT + 1), width);
+	    return;
 	  }
+	if(u) mult_local_disorder<MULT>(j, u, width);
+	stencil[io](phi0 + j * nvec, phiM1 + j * nvec, stencil_distance[io], t, nullptr, value_type(0), width * nvec);
+      }
+    else
+      {
+	if(u) mult_local_disorder<MULT>(j, u, width);
+	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+	  kernel.axpy(phi0, phiM1, j * nvec, stencil_distance[io][ib], T(value_type(MULT + 1) * c[ib]), width * nvec);
       }
   }
 			
@@ -225,8 +242,8 @@ public:
     
     unsigned i = 0;
     /*
-      Mosaic Multiplication using a TILE of STRIDE x STRIDE 
-      Right Now We expect that both ld[0] and ld[1]  are multiple of STRIDE
+      Mosaic Multiplication using a TILE of stride x stride
+      When the stride does not divide ld[0] or ld[1] the last tiles of the domain are shorter
       MULT = 0 : For the case of the Velocity/Hamiltonian
       MULT = 1 : For the case of the KPM_iteration
     */
@@ -245,50 +262,43 @@ public:
   template <unsigned MULT, bool VELOCITY>
   void KPM_MOTOR(T * phi0a, T * phiM1a, T *phiM2a, unsigned axis)
   {
-    std::size_t i0, i1;    
+    std::size_t i1;
     phi0 = phi0a;
     phiM1 = phiM1a;
     phiM2 = phiM2a;
+    coefficients = (VELOCITY ? h.hr.row_velocity.at(axis) : h.hr.row_hopping).data();
+    
+    if(h.hd.empty() && h.hV.vacancies_with_defects.empty())
+      {
+	/*
+	  Without structural disorder each tile only changes its own sites. The rows of tiles
+	  along the bottom and the top are computed first and their lines are sent to the
+	  neighbours, which receive them while the interior tiles are computed
+	*/
+	for( i1 = r.nghosts; i1 < r.Ld[1] - r.nghosts; i1 += r.stride  )
+	  if(r.boundary_tile(1, i1))
+	    mult_tile_row<MULT,VELOCITY>(i1, axis);
+	
+	send_faces(1);
+	
+	for( i1 = r.nghosts; i1 < r.Ld[1] - r.nghosts; i1 += r.stride  )
+	  if(!r.boundary_tile(1, i1))
+	    mult_tile_row<MULT,VELOCITY>(i1, axis);
+	
+	complete_exchange();
+	return;
+      }
     
     // Initialize tiles that have deffects connecting elements of a previous tile
     for(auto istr = h.cross_mozaic_indexes.begin(); istr != h.cross_mozaic_indexes.end() ; istr++)
       initiate_stride<MULT>(*istr);
     
-    for( i1 = NGHOSTS; i1 < r.Ld[1] - NGHOSTS; i1 += STRIDE  )
-      {
-	build_regular_phases<MULT,VELOCITY>(i1, axis);
-		
-	for( i0 = NGHOSTS; i0 < r.Ld[0] - NGHOSTS; i0 += STRIDE )
-	  {
-		    
-	    std::size_t istr = (i1 - NGHOSTS) /STRIDE * r.lStr[0] + (i0 - NGHOSTS)/ STRIDE;
-	    if(h.cross_mozaic.at(istr))
-	      initiate_stride<MULT>(istr);
-	    // These four lines pertrain only to the ghost_correlation field
-	    for(std::size_t io = 0; io < r.Orb; io++)
-	      {
-		const std::size_t ip = io * x.basis[2];
-		const std::size_t j0 = ip + i0 + i1 * std;
-		
-		// Local Energy
-		if(!VELOCITY) mult_local_disorder<MULT>(j0, io);
-		
-		// Hoppings
-		mult_regular_hoppings(j0, io);
-	      }
-	    for(auto id = h.hd.begin(); id != h.hd.end(); id++)
-	      id->template multiply_defect<MULT, VELOCITY>(istr, phi0, phiM1, axis);
-	  	    
-	    // Empty the vacancies in the tile
-	    auto & hV = h.hV.position.at(istr);
-	    for(auto k = hV.begin(); k != hV.end(); k++)
-	      phi0[*k] = 0.;
-
-	  }
-      }
-
+    for( i1 = r.nghosts; i1 < r.Ld[1] - r.nghosts; i1 += r.stride  )
+      mult_tile_row<MULT,VELOCITY>(i1, axis);
+    
     for(auto vc =  h.hV.vacancies_with_defects.begin(); vc != h.hV.vacancies_with_defects.end(); vc++)
-      phi0[*vc] = 0.;
+      for(unsigned ir = 0; ir < nvec; ir++)
+	kernel.set(phi0, *vc * nvec + ir, T(0.));
 
     
     /* 
@@ -298,79 +308,162 @@ public:
        We already subtract the vacancies from these contributions 
     */
     for(auto id = h.hd.begin(); id != h.hd.end(); id++)
-      id->template multiply_broken_defect<MULT,VELOCITY>(phi0, phiM1,axis);
+      id->template multiply_broken_defect<MULT,VELOCITY>(phi0, phiM1, axis, nvec, kernel);
 	  
-    // These four lines pertrain only to the ghost_correlation field
     Exchange_Boundaries();
-      }
-    
-	  // Periodic component of the Hamiltonian + Anderson disorder
-	  
+  }
   
-
-  void Exchange_Boundaries() {
-    /*
-      I have four boundaries to exchange with the other threads.
-      First I will copy the lines along the a[1] direction to a consecutive shared vector
-    */
-#pragma omp barrier    
-    Coordinates<std::size_t,3u> x(r.Ld), z(r.Lt);
-    T  *phi = v.col(index).data();
-    
+  template <unsigned MULT, bool VELOCITY>
+  void mult_tile_row(std::size_t i1, unsigned axis)
+  {
+    // Periodic component of the Hamiltonian + Anderson disorder in the row of tiles starting at i1
+    const std::size_t rows = r.tile_length(1, i1);
     
-    for(unsigned d = 0; d < 2; d++)
+    for(std::size_t i0 = r.nghosts; i0 < r.Ld[0] - r.nghosts; i0 += r.stride )
       {
 	
-	std::size_t BSize = r.Orb * max[d] * NGHOSTS;
-	T * ghosts_left = & simul.ghosts[0];
-	T * ghosts_right = & simul.ghosts[BSize];
-    
+	std::size_t istr = (i1 - r.nghosts) /r.stride * r.lStr[0] + (i0 - r.nghosts)/ r.stride;
+	const bool initiate = h.cross_mozaic.at(istr);
+	const std::size_t width = r.tile_length(0, i0);
+	
+	// The tile is swept row by row, so that the row being updated stays
+	// in cache for all the terms, whatever the number of vectors in the block
 	for(std::size_t io = 0; io < r.Orb; io++)
 	  {
-	    std::size_t il = MemIndBeg[d][0][io];
-	    std::size_t ir = MemIndBeg[d][1][io];
+	    const std::size_t ip = io * x.basis[2];
+	    const std::size_t j0 = ip + i0 + i1 * std;
 	    
-	    for(std::size_t i = 0; i < max[d]; i++)
+	    for(std::size_t j = j0, count = 0; count < rows; j += std, count++)
 	      {
-		for(unsigned ig = 0; ig < NGHOSTS; ig++)
-		  {
-		    ghosts_left [i + (ig + NGHOSTS*io) * max[d] ] = phi[il + ig*stride_ghosts[d]];
-		    ghosts_right[i + (ig + NGHOSTS*io) * max[d] ] = phi[ir + ig*stride_ghosts[d]];
-		  }
+		if(initiate) initiate_row<MULT>(j, width);
 		
-		il += stride[d];
-		ir += stride[d];
+		// Local energies and hoppings
+		mult_regular_hoppings<MULT,VELOCITY>(j, io, i1 + count, width);
 	      }
 	  }
+	for(auto id = h.hd.begin(); id != h.hd.end(); id++)
+	  id->template multiply_defect<MULT, VELOCITY>(istr, phi0, phiM1, axis, nvec, kernel);
 	
-	// Copy the boundaries to the shared memory
-	std::copy( ghosts_left, ghosts_left + 2 * BSize, simul.Global.ghosts.begin() + 2 * BSize * r.thread_id );	  
-#pragma omp barrier
-	auto neigh_left = simul.Global.ghosts.begin() + 2 * block[d][0] * BSize;
-	auto neigh_right  = simul.Global.ghosts.begin() + 2 * block[d][1] * BSize;
-	std::copy(neigh_right,         neigh_right + BSize , ghosts_right );     // From the left to the right
-	std::copy(neigh_left + BSize,  neigh_left + 2*BSize, ghosts_left  )  ;   // From the right to the left
+	// Empty the vacancies in the tile
+	auto & hV = h.hV.position.at(istr);
+	for(auto k = hV.begin(); k != hV.end(); k++)
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    kernel.set(phi0, *k * nvec + ir, T(0.));
 	
-#pragma omp barrier	
-	for(std::size_t io = 0; io < r.Orb; io++)
+      }
+  }
+  
+  void Exchange_Boundaries() {
+    /*
+      I have four boundaries to exchange with the other threads,
+      the lines along a[0] first and then the lines along a[1]
+    */
+    send_faces(1);
+    complete_exchange();
+  }
+  
+  void complete_exchange() {
+    receive_faces(1);
+    send_faces(0);
+    receive_faces(0);
+    this->finish_exchange();
+  }
+  
+#if DIRECT_GHOSTS
+  void send_faces(unsigned d) {
+    this->post_faces(d);
+  }
+  
+  void receive_faces(unsigned d) {
+    // The left ghosts are copied from the right boundary of the left neighbour, and vice versa
+    T  *phi = v.col(index).data();
+    T * neigh_left = this->wait_faces(block[d][0], d);
+    T * neigh_right = this->wait_faces(block[d][1], d);
+    
+    for(std::size_t io = 0; io < r.Orb; io++)
+      {
+	std::size_t il = MemIndEnd[d][0][io], jl = MemIndBeg[d][1][io];
+	std::size_t ir = MemIndEnd[d][1][io], jr = MemIndBeg[d][0][io];
+	
+	for(std::size_t i = 0; i < max[d]; i++)
 	  {
-	    std::size_t il = MemIndEnd[d][0][io];
-	    std::size_t ir = MemIndEnd[d][1][io];
+	    for(std::size_t ig = 0; ig < r.nghosts; ig++)
+	      for(unsigned k = 0; k < nvec; k++)
+		{
+		  kernel.set(phi, (il + ig*stride_ghosts[d]) * nvec + k, kernel.get(neigh_left,  (jl + ig*stride_ghosts[d]) * nvec + k));
+		  kernel.set(phi, (ir + ig*stride_ghosts[d]) * nvec + k, kernel.get(neigh_right, (jr + ig*stride_ghosts[d]) * nvec + k));
+		}
+	    il += stride[d];
+	    ir += stride[d];
+	    jl += stride[d];
+	    jr += stride[d];
+	  }
+      }
+    
+    this->release_faces(block[d][0], d);
+    this->release_faces(block[d][1], d);
+  }
+#else
+  void send_faces(unsigned d) {
+    // Copy the lines of the two opposite boundaries along d to a consecutive shared vector
+    T  *phi = v.col(index).data();
+    std::size_t BSize = r.Orb * max[d] * r.nghosts * nvec;
+    T * ghosts_left = & simul.ghosts[0];
+    T * ghosts_right = & simul.ghosts[BSize];
+    
+    for(std::size_t io = 0; io < r.Orb; io++)
+      {
+	std::size_t il = MemIndBeg[d][0][io];
+	std::size_t ir = MemIndBeg[d][1][io];
+	
+	for(std::size_t i = 0; i < max[d]; i++)
+	  {
+	    for(unsigned ig = 0; ig < r.nghosts; ig++)
+	      for(unsigned k = 0; k < nvec; k++)
+		{
+		  ghosts_left [(i + (ig + r.nghosts*io) * max[d]) * nvec + k] = kernel.get(phi, (il + ig*stride_ghosts[d]) * nvec + k);
+		  ghosts_right[(i + (ig + r.nghosts*io) * max[d]) * nvec + k] = kernel.get(phi, (ir + ig*stride_ghosts[d]) * nvec + k);
+		}
 	    
-	    for(std::size_t i = 0; i < max[d]; i++)
-	      {
-		for(int ig = 0; ig < NGHOSTS; ig++)
-		  {
-		    phi[il + ig*stride_ghosts[d]] = ghosts_left [i + (ig + NGHOSTS*io) * max[d]];
-		    phi[ir + ig*stride_ghosts[d]] = ghosts_right[i + (ig + NGHOSTS*io) * max[d]];
-		  }
-		il += stride[d];
-		ir += stride[d];
-	      }
+	    il += stride[d];
+	    ir += stride[d];
+	  }
+      }
+    
+    // Copy the boundaries to the shared memory
+    this->post_faces(d, 2 * BSize);
+  }
+  
+  void receive_faces(unsigned d) {
+    T  *phi = v.col(index).data();
+    std::size_t BSize = r.Orb * max[d] * r.nghosts * nvec;
+    T * ghosts_left = & simul.ghosts[0];
+    T * ghosts_right = & simul.ghosts[BSize];
+    
+    T * neigh_left = this->wait_faces(block[d][0], d);
+    T * neigh_right = this->wait_faces(block[d][1], d);
+    std::copy(neigh_right,         neigh_right + BSize , ghosts_right );     // From the left to the right
+    std::copy(neigh_left + BSize,  neigh_left + 2*BSize, ghosts_left  )  ;   // From the right to the left
+    
+    for(std::size_t io = 0; io < r.Orb; io++)
+      {
+	std::size_t il = MemIndEnd[d][0][io];
+	std::size_t ir = MemIndEnd[d][1][io];
+	
+	for(std::size_t i = 0; i < max[d]; i++)
+	  {
+	    for(std::size_t ig = 0; ig < r.nghosts; ig++)
+	      for(unsigned k = 0; k < nvec; k++)
+		{
+		  kernel.set(phi, (il + ig*stride_ghosts[d]) * nvec + k, ghosts_left [(i + (ig + r.nghosts*io) * max[d]) * nvec + k]);
+		  kernel.set(phi, (ir + ig*stride_ghosts[d]) * nvec + k, ghosts_right[(i + (ig + r.nghosts*io) * max[d]) * nvec + k]);
+		}
+	    il += stride[d];
+	    ir += stride[d];
 	  }
       }
-      
   }
+#endif
   
  
   void test_boundaries_system() {
@@ -383,11 +476,11 @@ public:
     Coordinates<std::size_t, 3> x(r.Ld);
     
     for(std::size_t  io = 0; io < (std::size_t) r.Ld[2]; io++)
-      for(std::size_t i1 = NGHOSTS; i1 < (std::size_t) r.Ld[1] - NGHOSTS ; i1++)
-	for(std::size_t i0 = NGHOSTS; i0 < (std::size_t) r.Ld[0] - NGHOSTS ; i0++)
+      for(std::size_t i1 = r.nghosts; i1 < (std::size_t) r.Ld[1] - r.nghosts ; i1++)
+	for(std::size_t i0 = r.nghosts; i0 < (std::size_t) r.Ld[0] - r.nghosts ; i0++)
 	  {
 	    r.convertCoordinates(z, x.set({i0,i1,io}) );
-	    v(x.set({i0,i1,io}).index, 0) = aux_wr(z.index);
+	    set_value(x.set({i0,i1,io}).index * nvec, 0, aux_wr(z.index));
 	  }
     
     Exchange_Boundaries();
@@ -401,8 +494,8 @@ public:
 	    for(std::size_t i0 = 0; i0 < (std::size_t) r.Ld[0]; i0++)
 	      {
 		r.convertCoordinates(z, x.set({i0,i1,io}) );
-		T val = aux_wr(z.index); 
-		if( aux_test(v(x.index , 0), val ) )
+		T val = aux_wr(z.index), w = get_value(x.index * nvec, 0);
+		if( aux_test(w, val ) )
 		  {
 		    // std::cout << "Problems---->" << v(x.index , 0) << " " << val << std::endl;
 		    //std::cout << "\t wrong " << std::real(v(x.index , 0)) << " " << z.index << " " << x.index << "\t\t";
@@ -426,27 +519,31 @@ public:
     
     
     // There are four sides, so set the ghosts in each side to zero individually.
-    // Remember that the size of the ghost boundaries depends on NGHOSTS.
+    // Remember that the size of the ghost boundaries depends on nghosts.
     
     for(long  io = 0; io < (long) r.Ld[2]; io++)
       for(long i0 = 0; i0 < (long) r.Ld[0]; i0++)
-	for(int d = 0; d < NGHOSTS; d++)
-	  v(x.set({i0,(long) d,io}).index, mem_index) *= 0;
+	for(long d = 0; d < (long) r.nghosts; d++)
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    set_value(x.set({i0,(long) d,io}).index * nvec + ir, mem_index, T(0.));
 
     for(long  io = 0; io < (long) r.Ld[2]; io++)
       for(long i0 = 0; i0 < (long) r.Ld[0]; i0++)
-	for(int d = 0; d < NGHOSTS; d++)
-	  v(x.set({i0, (long) (r.Ld[1] - 1 - d),io}).index, mem_index) *= 0;
+	for(long d = 0; d < (long) r.nghosts; d++)
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    set_value(x.set({i0, (long) (r.Ld[1] - 1 - d),io}).index * nvec + ir, mem_index, T(0.));
   
     for(long  io = 0; io < (long) r.Ld[2]; io++)
       for(long i1 = 0; i1 < (long) r.Ld[1]; i1++)
-	for(int d = 0; d < NGHOSTS; d++)
-	  v(x.set({(long) d,i1,io}).index, mem_index) *= 0;
+	for(long d = 0; d < (long) r.nghosts; d++)
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    set_value(x.set({(long) d,i1,io}).index * nvec + ir, mem_index, T(0.));
 
     for(long  io = 0; io < (long) r.Ld[2]; io++)
       for(long i1 = 0; i1 < (long) r.Ld[1]; i1++)
-	for(int d = 0; d < NGHOSTS; d++)
-	  v(x.set({(long) (r.Ld[0] - 1 - d),i1,io}).index, mem_index) *= 0;
+	for(long d = 0; d < (long) r.nghosts; d++)
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    set_value(x.set({(long) (r.Ld[0] - 1 - d),i1,io}).index * nvec + ir, mem_index, T(0.));
 
   };
   
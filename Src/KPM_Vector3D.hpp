@@ -0,0 +1,512 @@
+/****************************************************************/
+/*                                                              */
+/*  Copyright (C) 2018, M. Andelkovic, L. Covaci, A. Ferreira,  */
+/*                    S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                              */
+/****************************************************************/
+
+template <typename T>
+class KPM_Vector <T, 3> : public KPM_VectorBasis <T,3> {
+private:
+  std::size_t        face_axis[3][2]; // The two axes spanning the face exchanged along each direction
+  std::size_t         face_beg[3][2]; // First coordinate of the face along each of these axes
+  std::size_t         face_len[3][2]; // Length of the face along each of these axes
+  std::size_t           block[3][2];
+  LatticeStructure<3u>       & r;
+  Hamiltonian<T,3u>          & h;
+  const T                 *coefficients; // Hoppings of each row of the domain, with their phases
+  std::vector<typename extract_value_type<T>::value_type> row_energy; // On-site energies of a row of a tile
+  typename Stencil<T>::row_type *stencil;
+  std::ptrdiff_t     **stencil_distance;
+  Coordinates<std::size_t,4>   x;
+  T                        *phi0;
+  T                       *phiM1;
+  T                       *phiM2;
+  const std::size_t          std;
+  const std::size_t         pstd;
+public:
+  typedef typename extract_value_type<T>::value_type value_type;
+  using KPM_VectorBasis<T,3>::simul;
+  using KPM_VectorBasis<T,3>::index;
+  using KPM_VectorBasis<T,3>::v;
+  using KPM_VectorBasis<T,3>::memory;
+  using KPM_VectorBasis<T,3>::nvec;
+  using KPM_VectorBasis<T,3>::kernel;
+  using KPM_VectorBasis<T,3>::get_value;
+  using KPM_VectorBasis<T,3>::set_value;
+  using KPM_VectorBasis<T,3>::aux_wr;
+  using KPM_VectorBasis<T,3>::aux_test;
+  using KPM_VectorBasis<T,3>::inc_index;
+
+  KPM_Vector(int mem, Simulation<T,3> & sim, unsigned nv = 1) : KPM_VectorBasis<T,3>(mem, sim, nv), r(sim.r), h(sim.h), x(r.Ld), std(x.basis[1]), pstd(x.basis[2]) {
+    Coordinates <int, 4> x(r.nd), dist(r.nd);
+
+    stencil = new typename Stencil<T>::row_type[r.Orb];
+    stencil_distance = new std::ptrdiff_t*[r.Orb];
+    row_energy.resize(r.stride);
+    for(unsigned io = 0; io < r.Orb; io++)
+      {
+	// Specialized kernel for the number of hoppings of this orbital, if there is one
+	stencil[io] = Stencil<T>::select(h.hr.NHoppings(io));
+	stencil_distance[io] = new std::ptrdiff_t[h.hr.NHoppings(io)];
+	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+	  stencil_distance[io][ib] = h.hr.distance(ib, io) * std::ptrdiff_t(nvec);
+      }
+
+    /*
+      The faces are exchanged one direction at a time, from a[2] to a[0]. Along the
+      directions that were already exchanged the face includes the ghosts, so that the
+      edges and corners of the domain are filled in the subsequent exchanges
+    */
+    for(unsigned d = 0; d < 3; d++)
+      {
+	unsigned n = 0;
+	for(unsigned a = 0; a < 3; a++)
+	  if(a != d)
+	    {
+	      face_axis[d][n] = a;
+	      face_beg[d][n]  = (a > d ? 0 : r.nghosts);
+	      face_len[d][n]  = (a > d ? r.Ld[a] : r.ld[a]);
+	      n++;
+	    }
+      }
+
+    for(unsigned d = 0 ; d < 3; d++)
+      for(unsigned b  = 0 ; b < 2; b++)
+	{
+	  dist.set({0,0,0,0});
+	  dist.coord[d] = int(b) * 2 - 1;
+	  block[d][b] = x.set_coord( int(r.thread_id) ).add(dist).index;
+	}
+    // The vector starts random, without changing the numbers of the random vectors of the calculations
+    const std::uint64_t vectors = simul.rnd.vectors;
+    initiate_vector();
+    simul.rnd.vectors = vectors;
+  };
+
+
+  ~KPM_Vector(void){
+    for(unsigned io = 0; io < r.Orb;io++)
+      {
+	delete [] stencil_distance[io];
+      }
+    delete [] stencil_distance;
+    delete [] stencil;
+  }
+
+  void initiate_vector() {
+    initiate_vector(nvec);
+  };
+
+  void initiate_vector(unsigned nactive) {
+    /*
+      Only the first nactive vectors of the block are random,
+      the remaining ones are set to zero and do not contribute to the moments
+    */
+    index = 0;
+    // The random vectors are numbered in the order they are drawn, and each element is
+    // a function of the number of the vector and of the global index of the site
+    const std::uint64_t first = simul.rnd.vectors;
+    simul.rnd.vectors += nactive;
+    const value_type scale = value_type(1) / sqrt(value_type(r.Sizet - r.SizetVacancies));
+    const std::size_t width = r.Ld[0] - 2 * r.nghosts;
+    std::vector<T> row(width);
+    Coordinates<std::ptrdiff_t, 4> x(r.Ld), global(r.Lt);
+    for(std::size_t io = 0; io < r.Orb; io++)
+      for(std::size_t i2 = r.nghosts; i2 < r.Ld[2] - r.nghosts; i2++)
+	for(std::size_t i1 = r.nghosts; i1 < r.Ld[1] - r.nghosts; i1++)
+	  {
+	    // The sites of a row are consecutive in the domain and in the whole lattice
+	    r.convertCoordinates(global, x.set({std::ptrdiff_t(r.nghosts), std::ptrdiff_t(i1), std::ptrdiff_t(i2), std::ptrdiff_t(io)}));
+	    for(unsigned ir = 0; ir < nvec; ir++)
+	      {
+		if(ir < nactive)
+		  simul.rnd.init_row(global.index, first + ir, width, scale, row.data());
+		else
+		  std::fill(row.begin(), row.end(), T(0.));
+		for(std::size_t i = 0; i < width; i++)
+		  set_value((x.index + i) * nvec + ir, index, row[i]);
+	      }
+	  }
+
+    // The vacancies are few, so they are zeroed one by one
+    for(unsigned i = 0; i < r.NStr; i++)
+      {
+	auto & vv = h.hV.position.at(i);
+	for(unsigned j = 0; j < vv.size(); j++)
+	  for(unsigned ir = 0; ir < nvec; ir++)
+	    set_value(vv.at(j) * nvec + ir, index, T(0.));
+      }
+
+  };
+
+  template < unsigned MULT>
+  void initiate_stride(std::size_t & istr)
+  {
+    std::size_t i0, i1, i2;
+    i0 = ((istr) % r.lStr[0] ) * r.stride + r.nghosts;
+    i1 = ((istr) / r.lStr[0] % r.lStr[1] ) * r.stride + r.nghosts;
+    i2 = ((istr) / (r.lStr[0] * r.lStr[1]) ) * r.stride + r.nghosts;
+    const std::size_t width = r.tile_length(0, i0), planes = r.tile_length(2, i2);
+
+    for(std::size_t io = 0; io < r.Orb; io++)
+      for(std::size_t k2 = 0; k2 < planes; k2++)
+	{
+	  const std::size_t j0 = io * x.basis[3] + i0 + i1 * std + (i2 + k2) * pstd;
+	  const std::size_t j1 = j0 + r.tile_length(1, i1) * std;
+
+	  for(std::size_t j = j0; j < j1; j += std )
+	    initiate_row<MULT>(j, width);
+	}
+  }
+
+  template < unsigned MULT>
+  void inline initiate_row(const  std::size_t & j, const std::size_t & width)
+  {
+    kernel.scale(phi0, phiM2, j * nvec, - value_type(MULT), width * nvec);
+  }
+
+  template < unsigned MULT>
+  void inline mult_local_disorder(const  std::size_t & j, const value_type * u, const std::size_t & width)
+  {
+    // On-site energies u of the row starting at j, shared by the nvec vectors of the block
+    if(nvec == 1)
+      kernel.axpy_diag(phi0, phiM1, j, u, value_type(MULT + 1), width);
+    else
+      for(std::size_t i = 0; i < width ; i++)
+	kernel.axpy(phi0, phiM1, (j + i) * nvec, 0, T(value_type(MULT + 1) * u[i]), nvec);
+  }
+
+  template < unsigned MULT, bool VELOCITY>
+  void inline mult_regular_hoppings(const  std::size_t & j, const  std::size_t & io, const std::size_t & i1, const std::size_t & width)
+  {
+    /*
+      Hoppings and on-site energies: the nvec vectors of the block share each coefficient and
+      neighbour address. With a single vector the on-site energies are added by the stencil
+    */
+    const T * c = coefficients + (i1 * r.Orb + io) * h.hr.row_hopping.rows();
+    const value_type * u = (!VELOCITY && h.onsite_disorder ? h.onsite_energies(j, width, row_energy.data()) : nullptr);
+    if(stencil[io] != nullptr)
+      {
+	T t[STENCIL_MAX_HOPPINGS];
+	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+	  t[ib] = value_type(MULT + 1) * c[ib];
+	if(nvec == 1)
+	  {
+	    stencil[io](phi0 + j, phiM1 + j, stencil_distance[io], t, u, value_type(MULT + 1), width);
+	    return;
+	  }
+	if(u) mult_local_disorder<MULT>(j, u, width);
+	stencil[io](phi0 + j * nvec, phiM1 + j * nvec, stencil_distance[io], t, nullptr, value_type(0), width * nvec);
+      }
+    else
+      {
+	if(u) mult_local_disorder<MULT>(j, u, width);
+	for(unsigned ib = 0; ib < h.hr.NHoppings(io); ib++)
+	  kernel.axpy(phi0, phiM1, j * nvec, stencil_distance[io][ib], T(value_type(MULT + 1) * c[ib]), width * nvec);
+      }
+  }
+
+  template <unsigned MULT>
+  void Multiply() {
+    vverbose_message("Entered Multiply");
+
+    unsigned i = 0;
+    /*
+      Mosaic Multiplication using a TILE of stride x stride x stride
+      When the stride does not divide ld[0], ld[1] or ld[2] the last tiles of the domain are shorter
+      MULT = 0 : For the case of the Velocity/Hamiltonian
+      MULT = 1 : For the case of the KPM_iteration
+    */
+    inc_index();
+    phi0 = v.col(index).data();
+    phiM1 = v.col((memory + index - 1) % memory ).data();
+    phiM2 = v.col((memory + index - 2) % memory ).data();
+    KPM_MOTOR<MULT, false>(phi0, phiM1, phiM2, i);
+  };
+
+
+  void Velocity(T * phi0,T * phiM1, unsigned axis) {
+    KPM_MOTOR<0u, true>(phi0, phiM1, phiM1, axis);
+  };
+
+  template <unsigned MULT, bool VELOCITY>
+  void KPM_MOTOR(T * phi0a, T * phiM1a, T *phiM2a, unsigned axis)
+  {
+    std::size_t i2;
+    phi0 = phi0a;
+    phiM1 = phiM1a;
+    phiM2 = phiM2a;
+    coefficients = (VELOCITY ? h.hr.row_velocity.at(axis) : h.hr.row_hopping).data();
+
+    if(h.hd.empty() && h.hV.vacancies_with_defects.empty())
+      {
+	/*
+	  Without structural disorder each tile only changes its own sites. The planes of tiles
+	  along the bottom and the top faces are computed first and these faces are sent to the
+	  neighbours, which receive them while the interior tiles are computed
+	*/
+	for( i2 = r.nghosts; i2 < r.Ld[2] - r.nghosts; i2 += r.stride  )
+	  if(r.boundary_tile(2, i2))
+	    mult_tile_plane<MULT,VELOCITY>(i2, axis);
+
+	send_faces(2);
+
+	for( i2 = r.nghosts; i2 < r.Ld[2] - r.nghosts; i2 += r.stride  )
+	  if(!r.boundary_tile(2, i2))
+	    mult_tile_plane<MULT,VELOCITY>(i2, axis);
+
+	complete_exchange();
+	return;
+      }
+
+    // Initialize tiles that have deffects connecting elements of a previous tile
+    for(auto istr = h.cross_mozaic_indexes.begin(); istr != h.cross_mozaic_indexes.end() ; istr++)
+      initiate_stride<MULT>(*istr);
+
+    for( i2 = r.nghosts; i2 < r.Ld[2] - r.nghosts; i2 += r.stride  )
+      mult_tile_plane<MULT,VELOCITY>(i2, axis);
+
+    for(auto vc =  h.hV.vacancies_with_defects.begin(); vc != h.hV.vacancies_with_defects.end(); vc++)
+      for(unsigned ir = 0; ir < nvec; ir++)
+	kernel.set(phi0, *vc * nvec + ir, T(0.));
+
+    /*
+       Broken Imputirities:
+       The bulk domain will receive contributions from the broken defects
+       located on the neighbour domains.
+       We already subtract the vacancies from these contributions
+    */
+    for(auto id = h.hd.begin(); id != h.hd.end(); id++)
+      id->template multiply_broken_defect<MULT,VELOCITY>(phi0, phiM1, axis, nvec, kernel);
+
+    Exchange_Boundaries();
+  }
+
+  template <unsigned MULT, bool VELOCITY>
+  void mult_tile_plane(std::size_t i2, unsigned axis)
+  {
+    // Periodic component of the Hamiltonian + Anderson disorder in the plane of tiles starting at i2
+    const std::size_t planes = r.tile_length(2, i2);
+    for(std::size_t i1 = r.nghosts; i1 < r.Ld[1] - r.nghosts; i1 += r.stride  )
+      {
+	const std::size_t rows = r.tile_length(1, i1);
+
+	for(std::size_t i0 = r.nghosts; i0 < r.Ld[0] - r.nghosts; i0 += r.stride )
+	  {
+	    std::size_t istr = ((i2 - r.nghosts) / r.stride * r.lStr[1] + (i1 - r.nghosts) / r.stride) * r.lStr[0] + (i0 - r.nghosts) / r.stride;
+	    const bool initiate = h.cross_mozaic.at(istr);
+	    const std::size_t width = r.tile_length(0, i0);
+
+	    // The tile is swept plane by plane and row by row, the neighbouring
+	    // planes of the row being updated stay in cache
+	    for(std::size_t io = 0; io < r.Orb; io++)
+	      for(std::size_t k2 = 0; k2 < planes; k2++)
+		{
+		  const std::size_t j0 = io * x.basis[3] + i0 + i1 * std + (i2 + k2) * pstd;
+
+		  for(std::size_t j = j0, count = 0; count < rows; j += std, count++)
+		    {
+		      if(initiate) initiate_row<MULT>(j, width);
+
+		      // Local energies and hoppings
+		      mult_regular_hoppings<MULT,VELOCITY>(j, io, i1 + count, width);
+		    }
+		}
+
+	    for(auto id = h.hd.begin(); id != h.hd.end(); id++)
+	      id->template multiply_defect<MULT, VELOCITY>(istr, phi0, phiM1, axis, nvec, kernel);
+
+	    // Empty the vacancies in the tile
+	    auto & hV = h.hV.position.at(istr);
+	    for(auto k = hV.begin(); k != hV.end(); k++)
+	      for(unsigned ir = 0; ir < nvec; ir++)
+		kernel.set(phi0, *k * nvec + ir, T(0.));
+	  }
+      }
+  }
+
+  void copy_face(T * phi, T * buffer, unsigned d, std::size_t c, bool to_buffer) {
+    /*
+      Copies the nghosts layers of the face perpendicular to the direction d,
+      starting at the coordinate c along d, to (or from) a consecutive buffer
+    */
+    const std::size_t a = face_axis[d][0], b = face_axis[d][1];
+    const std::size_t na = face_len[d][0], nb = face_len[d][1];
+    std::size_t k = 0;
+
+    for(std::size_t io = 0; io < r.Orb; io++)
+      for(unsigned ig = 0; ig < r.nghosts; ig++)
+	for(std::size_t ib = 0; ib < nb; ib++)
+	  {
+	    std::size_t i = io * x.basis[3] + (c + ig) * x.basis[d] + face_beg[d][0] * x.basis[a] + (face_beg[d][1] + ib) * x.basis[b];
+	    for(std::size_t ia = 0; ia < na; ia++, i += x.basis[a])
+	      for(unsigned ir = 0; ir < nvec; ir++, k++)
+		{
+		  if(to_buffer)
+		    buffer[k] = kernel.get(phi, i * nvec + ir);
+		  else
+		    kernel.set(phi, i * nvec + ir, buffer[k]);
+		}
+	  }
+  }
+
+  void copy_face(T * phi, std::size_t c, const T * neigh, std::size_t cn, unsigned d) {
+    /*
+      Copies the nghosts layers of the face perpendicular to the direction d of the column
+      neigh, starting at the coordinate cn along d, to the layers starting at c of phi
+    */
+    const std::size_t a = face_axis[d][0], b = face_axis[d][1];
+    const std::size_t na = face_len[d][0], nb = face_len[d][1];
+    const std::ptrdiff_t shift = (std::ptrdiff_t(cn) - std::ptrdiff_t(c)) * std::ptrdiff_t(x.basis[d] * nvec);
+
+    for(std::size_t io = 0; io < r.Orb; io++)
+      for(unsigned ig = 0; ig < r.nghosts; ig++)
+	for(std::size_t ib = 0; ib < nb; ib++)
+	  {
+	    std::size_t i = io * x.basis[3] + (c + ig) * x.basis[d] + face_beg[d][0] * x.basis[a] + (face_beg[d][1] + ib) * x.basis[b];
+	    for(std::size_t ia = 0; ia < na; ia++, i += x.basis[a])
+	      for(unsigned ir = 0; ir < nvec; ir++)
+		kernel.set(phi, i * nvec + ir, kernel.get(neigh, i * nvec + ir + shift));
+	  }
+  }
+
+  void Exchange_Boundaries() {
+    /*
+      I have six faces to exchange with the other threads,
+      one direction at a time from a[2] to a[0]
+    */
+    send_faces(2);
+    complete_exchange();
+  }
+
+  void complete_exchange() {
+    for(unsigned d = 2; d > 0; d--)
+      {
+	receive_faces(d);
+	send_faces(d - 1);
+      }
+    receive_faces(0);
+    this->finish_exchange();
+  }
+
+#if DIRECT_GHOSTS
+  void send_faces(unsigned d) {
+    this->post_faces(d);
+  }
+
+  void receive_faces(unsigned d) {
+    // The left ghosts are copied from the right face of the left neighbour, and vice versa
+    T  *phi = v.col(index).data();
+    T * neigh_left = this->wait_faces(block[d][0], d);
+    T * neigh_right = this->wait_faces(block[d][1], d);
+
+    copy_face(phi, 0,                   neigh_left,  r.Ld[d] - 2 * r.nghosts, d);
+    copy_face(phi, r.Ld[d] - r.nghosts, neigh_right, r.nghosts,               d);
+
+    this->release_faces(block[d][0], d);
+    this->release_faces(block[d][1], d);
+  }
+#else
+  void send_faces(unsigned d) {
+    // Copy the two opposite faces along d to a consecutive shared vector
+    T  *phi = v.col(index).data();
+    std::size_t BSize = r.Orb * face_len[d][0] * face_len[d][1] * r.nghosts * nvec;
+    T * ghosts_left = & simul.ghosts[0];
+    T * ghosts_right = & simul.ghosts[BSize];
+
+    copy_face(phi, ghosts_left,  d, r.nghosts,                 true);
+    copy_face(phi, ghosts_right, d, r.Ld[d] - 2 * r.nghosts,   true);
+    this->post_faces(d, 2 * BSize);
+  }
+
+  void receive_faces(unsigned d) {
+    T  *phi = v.col(index).data();
+    std::size_t BSize = r.Orb * face_len[d][0] * face_len[d][1] * r.nghosts * nvec;
+    T * ghosts_left = & simul.ghosts[0];
+    T * ghosts_right = & simul.ghosts[BSize];
+
+    T * neigh_left = this->wait_faces(block[d][0], d);
+    T * neigh_right = this->wait_faces(block[d][1], d);
+    std::copy(neigh_right,         neigh_right + BSize , ghosts_right );     // From the left to the right
+    std::copy(neigh_left + BSize,  neigh_left + 2*BSize, ghosts_left  )  ;   // From the right to the left
+
+    copy_face(phi, ghosts_left,  d, 0,                       false);
+    copy_face(phi, ghosts_right, d, r.Ld[d] - r.nghosts,       false);
+  }
+#endif
+
+
+  void test_boundaries_system() {
+
+    /*
+      This  function tests if the boudaries exchange are well implemented
+    */
+
+    Coordinates<std::size_t, 4> z(r.Lt);
+    Coordinates<std::size_t, 4> x(r.Ld);
+
+    for(std::size_t  io = 0; io < (std::size_t) r.Ld[3]; io++)
+      for(std::size_t i2 = r.nghosts; i2 < (std::size_t) r.Ld[2] - r.nghosts ; i2++)
+	for(std::size_t i1 = r.nghosts; i1 < (std::size_t) r.Ld[1] - r.nghosts ; i1++)
+	  for(std::size_t i0 = r.nghosts; i0 < (std::size_t) r.Ld[0] - r.nghosts ; i0++)
+	    {
+	      r.convertCoordinates(z, x.set({i0,i1,i2,io}) );
+	      set_value(x.set({i0,i1,i2,io}).index * nvec, 0, aux_wr(z.index));
+	    }
+
+    Exchange_Boundaries();
+
+#pragma omp critical
+    {
+      for(std::size_t  io = 0; io < (std::size_t) r.Ld[3]; io++)
+	for(std::size_t i2 = 0; i2 < (std::size_t) r.Ld[2] ; i2++)
+	  for(std::size_t i1 = 0; i1 < (std::size_t) r.Ld[1] ; i1++)
+	    for(std::size_t i0 = 0; i0 < (std::size_t) r.Ld[0]; i0++)
+	      {
+		r.convertCoordinates(z, x.set({i0,i1,i2,io}) );
+		T val = aux_wr(z.index), w = get_value(x.index * nvec, 0);
+		if( aux_test(w, val ) )
+		  x.print();
+	      }
+    }
+
+  };
+
+  void empty_ghosts(int mem_index) {
+    /* This function takes the kpm vector that's being used, 'v' and sets to zero the part corresponding
+     * to the ghosts, that is, the part of the vector that actually belongs to a different thread.
+     * This is done so that when we take the dot product 'v' with another vector only terms pertraining
+     * to the current thread are considered.
+     * */
+
+    Coordinates<long, 4> x(r.Ld);
+
+    // There are six faces, each of them nghosts thick
+    for(unsigned d = 0; d < 3; d++)
+      {
+	const unsigned a = (d == 0 ? 1 : 0), b = (d == 2 ? 1 : 2);
+	for(long  io = 0; io < (long) r.Ld[3]; io++)
+	  for(long ib = 0; ib < (long) r.Ld[b]; ib++)
+	    for(long ia = 0; ia < (long) r.Ld[a]; ia++)
+	      for(long g = 0; g < (long) r.nghosts; g++)
+		{
+		  x.coord[a] = ia;
+		  x.coord[b] = ib;
+		  x.coord[3] = io;
+
+		  x.coord[d] = g;
+		  x.set_index(x.coord);
+		  for(unsigned ir = 0; ir < nvec; ir++)
+		    set_value(x.index * nvec + ir, mem_index, T(0.));
+
+		  x.coord[d] = r.Ld[d] - 1 - g;
+		  x.set_index(x.coord);
+		  for(unsigned ir = 0; ir < nvec; ir++)
+		    set_value(x.index * nvec + ir, mem_index, T(0.));
+		}
+      }
+  };
+
+};
+
@@ -107,49 +107,67 @@ public:
   unsigned Ld[D+1]; // Dimensions of each sub-domain (domain  + ghosts) 
   unsigned ld[D+1]; // Dimensions of each sub-domain (domain) 
   unsigned Bd[D+1]; // Information about periodic or non-periodic boundary conditions
-  unsigned lStr[D + 1];
+  unsigned lStr[D + 1]; // Number of tiles of the sub-domain in each dimension
+  std::size_t stride;  // Size of the tiles swept by the KPM iteration
+  std::size_t nghosts; // Extra length of the sub-domain in each direction
   std::size_t Nt; // Number of lattice postions of the global sample
   std::size_t Nd; // Number of lattice postions of the sub-domain with ghosts
   std::size_t N; // Number of lattice postions of the sub-domain without ghosts
   std::size_t NStr; // Number of lattice postions of the sub-domain without ghosts
   unsigned Orb; // Number of orbitals
   unsigned thread_id; // thread identification
-  int MagneticField;
+  int MagneticField; // Number of flux quanta of the magnetic field, the flux through each unit cell is MagneticField/Lt[1]
 
   
   Eigen::Matrix<double, D, D> ghost_pot; // ghosts_correlation potential
   
-  LatticeStructure(char *name ) {
-#pragma omp critical
-    {
-      H5::H5File *file = new H5::H5File(name, H5F_ACC_RDONLY);
-      get_hdf5<unsigned>(&Orb, file, (char *) "/NOrbitals");
-      get_hdf5<double>(rLat.data(), file, (char *) "/LattVectors");    
-      rOrb = Eigen::MatrixXd::Zero(D, Orb);
-      get_hdf5<double>(rOrb.data(), file, (char *) "/OrbPositions");
-      
-      get_hdf5<unsigned>(Lt, file, (char *) "/L");
-      get_hdf5<unsigned>(Bd, file, (char *) "/Boundaries");
-      get_hdf5<unsigned>(nd, file, (char *) "/Divisions");      
-      
-      // verify if the number of boundaries divides the length
-      if(Lt[0]%nd[0] != 0){
-        std::cout << "The number of divisions in the x direction ("<< nd[0] <<") must ";
-        std::cout << "be a divisor of the length of that side ("<< Lt[0] <<"). Exiting.\n";
-        exit(1);
-      }
-      if(Lt[1]%nd[1] != 0){
-        std::cout << "The number of divisions in the y direction ("<< nd[1] <<") must ";
-        std::cout << "be a divisor of the length of that side ("<< Lt[1] <<"). Exiting.\n";
-        exit(1);
-      }
-
-      file->close();
+  template <typename T>
+  LatticeStructure(const Configuration<T,D> & config, std::size_t tile = STRIDE) : stride(tile) {
+    Orb = config.Orb;
+    rLat = config.rLat;
+    rOrb = config.rOrb;
+    std::copy_n(config.Lt, D, Lt);
+    std::copy_n(config.Bd, D, Bd);
+    std::copy_n(config.nd, D, nd);
+    
+    // verify if the number of boundaries divides the length
+    if(Lt[0]%nd[0] != 0){
+      std::cout << "The number of divisions in the x direction ("<< nd[0] <<") must ";
+      std::cout << "be a divisor of the length of that side ("<< Lt[0] <<"). Exiting.\n";
+      exit(1);
+    }
+    if(Lt[1]%nd[1] != 0){
+      std::cout << "The number of divisions in the y direction ("<< nd[1] <<") must ";
+      std::cout << "be a divisor of the length of that side ("<< Lt[1] <<"). Exiting.\n";
+      exit(1);
+    }
+    if(D == 3 && Lt[2]%nd[2] != 0){
+      std::cout << "The number of divisions in the z direction ("<< nd[2] <<") must ";
+      std::cout << "be a divisor of the length of that side ("<< Lt[2] <<"). Exiting.\n";
+      exit(1);
+    }
+    
+    nghosts = config.nghosts;
+    if(nghosts < 1){
+      std::cout << "The width of the ghosts (NGhosts) must be at least 1. Exiting.\n";
+      exit(1);
+    }
+    
+    MagneticField = config.MagneticField;
+    if(MagneticField != 0 && (D < 2 || std::abs(MagneticField) >= int(Lt[1]))){
+      std::cout << "The number of flux quanta of the magnetic field (" << MagneticField << ") must be smaller ";
+      std::cout << "than the length of the system along a[1] (" << (D < 2 ? 0 : Lt[1]) << "). Exiting.\n";
+      exit(1);
     }
 
-    // Set the ghost_correlation potential and normalize it to the size of the system
+    /*
+      Set the ghost_correlation potential and normalize it to the size of the system. The hoppings along
+      a[0] get a phase proportional to the coordinate along a[1], which is periodic in the length Lt[1]
+      only for an integer number of flux quanta. Fluxes that differ by Lt[1] quanta are the same
+    */
     ghost_pot.setZero();
-		ghost_pot(0,1) = NUM_GHOST_CORR/Lt[1]*2.0*M_PI;
+    if(D > 1)
+      ghost_pot(0,1) = double(MagneticField)/Lt[1]*2.0*M_PI;
     
     Nd = 1;
     N = 1;
@@ -160,8 +178,14 @@ public:
     for(unsigned i = 0; i < D; i++)
       {
 	ld[i] = Lt[i]/nd[i];
-	Ld[i] = ld[i] + 2*NGHOSTS;
-	lStr[i] = ld[i]/STRIDE;
+	// The faces sent to the neighbours are the nghosts layers next to the ghosts, inside the domain
+	if(ld[i] < nghosts){
+	  std::cout << "The length of the sub-domains along the direction " << i << " (" << ld[i] << ") must ";
+	  std::cout << "be at least the width of the ghosts (" << nghosts << "). Exiting.\n";
+	  exit(1);
+	}
+	Ld[i] = ld[i] + 2*nghosts;
+	lStr[i] = (ld[i] + stride - 1)/stride; // The last tile is shorter when the stride does not divide ld
 	Nd *= Ld[i];
 	N  *= ld[i];
 	Nt *= Lt[i] ;
@@ -182,17 +206,27 @@ public:
     thread_id = omp_get_thread_num();
   };
   
+  std::size_t tile_length(unsigned d, std::size_t i) {
+    // Length along the direction d of the tile that starts at the coordinate i (with ghosts)
+    return std::min(stride, std::size_t(Ld[d] - nghosts) - i);
+  };
+  
+  bool boundary_tile(unsigned d, std::size_t i) {
+    // Tests if the tile that starts at the coordinate i along d contains sites sent to the neighbours
+    return i < 2 * nghosts || i + tile_length(d, i) > Ld[d] - 2 * nghosts;
+  };
+  
   unsigned get_BorderSize() {
     unsigned size;
     switch (D) {
     case 1 :
-      size = 2 * Orb * n_threads * NGHOSTS;
+      size = 2 * Orb * n_threads * nghosts;
       break;
     case 2:
-      size = 2 * std::max(Ld[0],ld[1]) * Orb * n_threads * NGHOSTS;
+      size = 2 * std::max(ld[0],Ld[1]) * Orb * n_threads * nghosts;
       break;
     case 3:
-      size = (2 * std::max(Ld[0] * Ld[1], std::max(Ld[0] * ld[2] , ld[1]*ld[2]) ) * Orb * n_threads) * NGHOSTS;
+      size = (2 * std::max(Ld[1] * Ld[2], std::max(ld[0] * Ld[2] , ld[0]*ld[1]) ) * Orb * n_threads) * nghosts;
       break;
     default:
       std::cout << "Error in LatticeBuilding.hpp. Exiting.\n";
@@ -212,7 +246,7 @@ public:
     if( std::equal(std::begin(source.L), std::end(source.L), std::begin(Ld)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(Lt)))
       {
 	for(unsigned i = 0; i < D; i++)
-	  dest.coord[i] =  (source.coord[i] + xd.coord[i] * ld[i] - NGHOSTS + Lt[i])%Lt[i] ;
+	  dest.coord[i] =  (source.coord[i] + xd.coord[i] * ld[i] - nghosts + Lt[i])%Lt[i] ;
 	dest.coord[D] = source.coord[D];
 	dest.set_index(dest.coord);
       }
@@ -229,7 +263,7 @@ public:
     if( std::equal(std::begin(source.L), std::end(source.L), std::begin(ld)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(Ld)))
       {
 	for(unsigned i = 0; i < D; i++)
-	  dest.coord[i] =  source.coord[i] + NGHOSTS ;
+	  dest.coord[i] =  source.coord[i] + nghosts ;
 	dest.coord[D] = source.coord[D];
 	dest.set_index(dest.coord);
       }
@@ -248,7 +282,7 @@ public:
     if( std::equal(std::begin(source.L), std::end(source.L), std::begin(Lt)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(Ld)))
       {
 	for(unsigned i = 0; i < D; i++)
-	  dest.coord[i] =  source.coord[i] - xd.coord[i] * ld[i] + NGHOSTS;
+	  dest.coord[i] =  source.coord[i] - xd.coord[i] * ld[i] + nghosts;
 	dest.coord[D] = source.coord[D];
 	dest.set_index(dest.coord);
       }
@@ -257,7 +291,7 @@ public:
     if( std::equal(std::begin(source.L), std::end(source.L), std::begin(Ld)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(lStr)))
       {
 	for(unsigned i = 0; i < D; i++)
-	  dest.coord[i] =  (source.coord[i] -NGHOSTS)/STRIDE;
+	  dest.coord[i] =  (source.coord[i] -nghosts)/stride;
 	dest.coord[D] = 0;
 	dest.set_index(dest.coord);
       }
@@ -267,7 +301,7 @@ public:
     if( std::equal(std::begin(source.L), std::end(source.L), std::begin(ld)) && std::equal(std::begin(dest.L), std::end(dest.L), std::begin(lStr)))
       {
 	for(unsigned i = 0; i < D; i++)
-	  dest.coord[i] =  source.coord[i]/STRIDE; 
+	  dest.coord[i] =  source.coord[i]/stride; 
 	dest.coord[D] = 0;
 	dest.set_index(dest.coord);
       }
@@ -308,7 +342,7 @@ public:
     bool teste = 1;
   
     for(int j = 0; j < int(D); j++)
-      if(teste && (Latt.coord[j] < NGHOSTS || Latt.coord[j] >= std::ptrdiff_t(Ld[j] - NGHOSTS)) )
+      if(teste && (std::ptrdiff_t(Latt.coord[j]) < std::ptrdiff_t(nghosts) || std::ptrdiff_t(Latt.coord[j]) >= std::ptrdiff_t(Ld[j] - nghosts)) )
 	teste = 0;                                        // node is in the ghosts!
       else  if(Latt.coord[j] < 0 || Latt.coord[j] > std::ptrdiff_t(Ld[j] - 1))
 	{
@@ -5,53 +5,178 @@
 /*                                                              */
 /****************************************************************/
 
+/*
+  Counter-based generator Philox4x32-10 (Salmon et al., SC'11). The four words are a function
+  of the counter and of the key only, so any number of a sequence is found without the previous
+  ones, in any order and by any thread.
+*/
+inline void philox4x32(std::uint32_t (&c)[4], std::uint32_t k0, std::uint32_t k1) {
+  for(int round = 0; round < 10; round++)
+    {
+      const std::uint64_t p0 = std::uint64_t(0xD2511F53u) * c[0];
+      const std::uint64_t p1 = std::uint64_t(0xCD9E8D57u) * c[2];
+      const std::uint32_t c0 = std::uint32_t(p1 >> 32) ^ c[1] ^ k0;
+      const std::uint32_t c2 = std::uint32_t(p0 >> 32) ^ c[3] ^ k1;
+      c[1] = std::uint32_t(p1);
+      c[3] = std::uint32_t(p0);
+      c[0] = c0;
+      c[2] = c2;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+}
+
+struct CounterRandom {
+  std::uint64_t key = 0;
+  
+  void uniform2(std::uint64_t counter, std::uint64_t stream, double & u0, double & u1) const {
+    // Two uniform numbers in (0, 1) with 53 bits, the number counter of the sequence stream
+    std::uint32_t c[4] = {std::uint32_t(counter), std::uint32_t(counter >> 32), std::uint32_t(stream), std::uint32_t(stream >> 32)};
+    philox4x32(c, std::uint32_t(key), std::uint32_t(key >> 32));
+    u0 = ((((std::uint64_t(c[0]) << 32) | c[1]) >> 11) + 0.5) / 9007199254740992.;
+    u1 = ((((std::uint64_t(c[2]) << 32) | c[3]) >> 11) + 0.5) / 9007199254740992.;
+  };
+  
+  double uniform(std::uint64_t counter, std::uint64_t stream, double mean, double width) const {
+    // mean  : mean value
+    // width : root mean square deviation
+    double u0, u1;
+    uniform2(counter, stream, u0, u1);
+    return mean + sqrt(3.) * width * (2 * u0 - 1);
+  };
+  
+  double gaussian(std::uint64_t counter, std::uint64_t stream, double mean, double width) const {
+    // Box-Muller transform of the two uniform numbers
+    double u0, u1;
+    uniform2(counter, stream, u0, u1);
+    return mean + width * sqrt(-2. * log(u0)) * cos(2 * M_PI * u1);
+  };
+  
+  void uniform_row(std::uint64_t counter, std::uint64_t stream, std::size_t n, double * u) const {
+    /*
+      u[k] is the first number of uniform2 for the counter + k. The rounds of Philox are applied
+      to batches of consecutive counters stored as separate words, so they are vectorized
+    */
+    const std::size_t batch = 16;
+    std::uint32_t c0[batch], c1[batch], c2[batch], c3[batch];
+    for(std::size_t k0 = 0; k0 < n; k0 += batch)
+      {
+	std::uint32_t key0 = std::uint32_t(key), key1 = std::uint32_t(key >> 32);
+#pragma omp simd
+	for(std::size_t k = 0; k < batch; k++)
+	  {
+	    c0[k] = std::uint32_t(counter + k0 + k);
+	    c1[k] = std::uint32_t((counter + k0 + k) >> 32);
+	    c2[k] = std::uint32_t(stream);
+	    c3[k] = std::uint32_t(stream >> 32);
+	  }
+	for(int round = 0; round < 10; round++)
+	  {
+#pragma omp simd
+	    for(std::size_t k = 0; k < batch; k++)
+	      {
+		const std::uint64_t p0 = std::uint64_t(0xD2511F53u) * c0[k];
+		const std::uint64_t p1 = std::uint64_t(0xCD9E8D57u) * c2[k];
+		c0[k] = std::uint32_t(p1 >> 32) ^ c1[k] ^ key0;
+		c2[k] = std::uint32_t(p0 >> 32) ^ c3[k] ^ key1;
+		c1[k] = std::uint32_t(p1);
+		c3[k] = std::uint32_t(p0);
+	      }
+	    key0 += 0x9E3779B9u;
+	    key1 += 0xBB67AE85u;
+	  }
+	const std::size_t m = std::min(batch, n - k0);
+#pragma omp simd
+	for(std::size_t k = 0; k < m; k++)
+	  u[k0 + k] = ((((std::uint64_t(c0[k]) << 32) | c1[k]) >> 11) + 0.5) / 9007199254740992.;
+      }
+  };
+};
+
+/*
+  Random numbers of one thread. They are drawn from the counter-based generator keyed with the
+  seed of the run. The counter is the global index of the site, and the sequence is set by the
+  kind of random numbers and by the disorder realization or the random vector they belong to.
+  Every number is then the same whatever the Divisions, the thread that draws it or the order
+  in which the sites are visited, and the runs with the same seed give the same results.
+*/
+enum random_kind {RANDOM_VECTOR, ANDERSON, VACANCIES, DEFECTS};
+
 template <typename T> 
 class KPMRandom {
-  std::mt19937 rng;
-  std::uniform_real_distribution <double> dist;
-  std::normal_distribution<> gauss;
+  CounterRandom generator;
+  std::vector<double> phase;     // Uniform numbers of a row of a random vector
 public:
+  std::uint64_t realization;     // Number of disorder realizations generated
+  std::uint64_t vectors;         // Number of random vectors drawn
   
   typedef typename extract_value_type<T>::value_type value_type;
   
   KPMRandom() {
-    init_random();
+    init_random(0);
   };
 
-  void init_random()
+  void init_random(std::uint64_t seed)
   {
-    std::random_device r;
-    std::array<int, 624> seed_data;
-    std::generate(seed_data.begin(), seed_data.end(), std::ref(r));
-    std::seed_seq seq(std::begin(seed_data), std::end(seed_data));
-    rng.seed(seq); 
+    generator.key = seed;
+    realization = 0;
+    vectors = 0;
   };
 
-  double get() {
-    return dist(rng);
+  std::uint64_t stream(random_kind kind, unsigned model) const {
+    // Sequence of the kind of disorder of the model in the current realization
+    return (std::uint64_t(kind) << 56) | (realization << 16) | model;
   };
   
-  double uniform(double  mean, double  width) {
+  double get(std::uint64_t site, std::uint64_t stream) const {
+    double u0, u1;
+    generator.uniform2(site, stream, u0, u1);
+    return u0;
+  };
+  
+  void get_row(std::uint64_t site, std::uint64_t stream, std::size_t n, double * u) const {
+    // The numbers of get for the sites site, ..., site + n - 1
+    generator.uniform_row(site, stream, n, u);
+  };
+  
+  double uniform(std::uint64_t site, std::uint64_t stream, double  mean, double  width) const {
     // mean  : mean value
     // width : root mean square deviation
-    return mean + sqrt(3.) * width * (2 * dist(rng)  - 1);
+    return generator.uniform(site, stream, mean, width);
   };
   
-  double gaussian(double  mean, double  width) {
+  double gaussian(std::uint64_t site, std::uint64_t stream, double  mean, double  width) const {
     // mean  : mean value
     // width : root mean square deviation
-    return mean + width*gauss(rng);
+    return generator.gaussian(site, stream, mean, width);
   };
   
   
   template <typename U = T>
-  typename std::enable_if<is_tt<std::complex, U>::value, U>::type init() {
-    return exp(T(0., value_type(2*M_PI*dist(rng)) ));
+  typename std::enable_if<is_tt<std::complex, U>::value, void>::type init_row(std::uint64_t site, std::uint64_t vector, std::size_t n, value_type scale, U * x) {
+    // Elements of the random vector in the sites site, ..., site + n - 1, with the modulus scale
+    // and a random phase. The cosines and sines are vectorized
+    phase.resize(2 * n);
+    double * c = phase.data(), * s = phase.data() + n;
+    generator.uniform_row(site, std::uint64_t(RANDOM_VECTOR) << 56 | vector, n, c);
+#pragma omp simd
+    for(std::size_t k = 0; k < n; k++)
+      {
+	s[k] = scale * sin(2 * M_PI * c[k]);
+	c[k] = scale * cos(2 * M_PI * c[k]);
+      }
+    for(std::size_t k = 0; k < n; k++)
+      x[k] = U(value_type(c[k]), value_type(s[k]));
   };
   
   template <typename U = T>
-  typename std::enable_if<!is_tt<std::complex, U>::value, U>::type init() {
-    return (2*dist(rng) - 1.)*sqrt(3);
+  typename std::enable_if<!is_tt<std::complex, U>::value, void>::type init_row(std::uint64_t site, std::uint64_t vector, std::size_t n, value_type scale, U * x) {
+    // Elements of the random vector in the sites site, ..., site + n - 1, uniform with the root mean square scale
+    phase.resize(n);
+    double * u = phase.data();
+    generator.uniform_row(site, std::uint64_t(RANDOM_VECTOR) << 56 | vector, n, u);
+#pragma omp simd
+    for(std::size_t k = 0; k < n; k++)
+      x[k] = U((2 * u[k] - 1.) * sqrt(3.) * scale);
   };
 };
-
@@ -0,0 +1,602 @@
+/****************************************************************/
+/*                                                              */
+/*  Copyright (C) 2018, M. Andelkovic, L. Covaci, A. Ferreira,  */
+/*                    S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                              */
+/****************************************************************/
+
+/*
+  Vectorized kernels of the KPM iteration:
+
+  axpy       : y[i] += a * x[i]
+  axpy_diag  : y[i] += c * u[i] * x[i]   with u real (local disorder)
+  axpy_split : the same as axpy for complex vectors stored as separate real and imaginary planes
+
+  The kernels for float, double, std::complex<float> and std::complex<double> are
+  written with SSE2, AVX2 and AVX-512 intrinsics and the version is chosen at runtime
+  from the features of the cpu, so it does not depend on the -march flag used to compile.
+  The complex kernels work on the interleaved (re, im) pairs:
+  a * x = a.re * (x.re, x.im) + a.im * (-x.im, x.re)
+  Other types, and other architectures, use the scalar loops.
+
+  When SPLIT_COMPLEX is set, every column of a complex KPM vector is stored as a plane
+  with the real parts followed by a plane with the imaginary parts (structure of arrays),
+  so that the complex products need no shuffles.
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+inline int simd_level() {
+  // 0 : scalar, 1 : SSE2, 2 : AVX2 + FMA, 3 : AVX-512
+#if SIMD >= 0
+  return SIMD;
+#elif SIMD_X86
+  static const int level = __builtin_cpu_supports("avx512f") ? 3 :
+    (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? 2 :
+    __builtin_cpu_supports("sse2") ? 1 : 0;
+  return level;
+#else
+  return 0;
+#endif
+}
+
+template <typename T>
+struct split_layout : std::integral_constant<bool, SPLIT_COMPLEX && is_tt<std::complex, T>::value> {};
+
+template <typename T>
+void axpy_scalar(T * y, const T * x, T a, std::size_t n) {
+  for(std::size_t i = 0; i < n; i++)
+    y[i] += a * x[i];
+}
+
+template <typename T>
+void axpy_diag_scalar(T * y, const T * x, const typename extract_value_type<T>::value_type * u,
+		      typename extract_value_type<T>::value_type c, std::size_t n) {
+  for(std::size_t i = 0; i < n; i++)
+    y[i] += c * x[i] * u[i];
+}
+
+template <typename T>
+void axpy_split_scalar(typename extract_value_type<T>::value_type * yr, typename extract_value_type<T>::value_type * yi,
+		       const typename extract_value_type<T>::value_type * xr, const typename extract_value_type<T>::value_type * xi,
+		       T a, std::size_t n) {
+  typedef typename extract_value_type<T>::value_type value_type;
+  const value_type ar = std::real(a), ai = std::imag(a);
+  for(std::size_t i = 0; i < n; i++)
+    {
+      yr[i] += ar * xr[i] - ai * xi[i];
+      yi[i] += ar * xi[i] + ai * xr[i];
+    }
+}
+
+#if SIMD_X86
+
+/* SSE2 */
+
+__attribute__((target("sse2")))
+inline void axpy_sse(float * y, const float * x, float a, std::size_t n) {
+  const __m128 va = _mm_set1_ps(a);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void axpy_sse(double * y, const double * x, double a, std::size_t n) {
+  const __m128d va = _mm_set1_pd(a);
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void axpy_sse(std::complex<float> * y, const std::complex<float> * x, std::complex<float> a, std::size_t n) {
+  const float * xr = reinterpret_cast<const float *>(x);
+  float * yr = reinterpret_cast<float *>(y);
+  const __m128 re = _mm_set1_ps(a.real());
+  const __m128 im = _mm_set_ps(a.imag(), -a.imag(), a.imag(), -a.imag());
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    {
+      const __m128 xv = _mm_loadu_ps(xr + 2 * i);
+      const __m128 xs = _mm_shuffle_ps(xv, xv, 0xB1);
+      _mm_storeu_ps(yr + 2 * i, _mm_add_ps(_mm_loadu_ps(yr + 2 * i), _mm_add_ps(_mm_mul_ps(re, xv), _mm_mul_ps(im, xs))));
+    }
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void axpy_sse(std::complex<double> * y, const std::complex<double> * x, std::complex<double> a, std::size_t n) {
+  const double * xr = reinterpret_cast<const double *>(x);
+  double * yr = reinterpret_cast<double *>(y);
+  const __m128d re = _mm_set1_pd(a.real());
+  const __m128d im = _mm_set_pd(a.imag(), -a.imag());
+  for(std::size_t i = 0; i < n; i++)
+    {
+      const __m128d xv = _mm_loadu_pd(xr + 2 * i);
+      const __m128d xs = _mm_shuffle_pd(xv, xv, 1);
+      _mm_storeu_pd(yr + 2 * i, _mm_add_pd(_mm_loadu_pd(yr + 2 * i), _mm_add_pd(_mm_mul_pd(re, xv), _mm_mul_pd(im, xs))));
+    }
+}
+
+__attribute__((target("sse2")))
+inline void axpy_diag_sse(float * y, const float * x, const float * u, float c, std::size_t n) {
+  const __m128 vc = _mm_set1_ps(c);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_mul_ps(vc, _mm_loadu_ps(x + i)), _mm_loadu_ps(u + i))));
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void axpy_diag_sse(double * y, const double * x, const double * u, double c, std::size_t n) {
+  const __m128d vc = _mm_set1_pd(c);
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(_mm_mul_pd(vc, _mm_loadu_pd(x + i)), _mm_loadu_pd(u + i))));
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void axpy_diag_sse(std::complex<float> * y, const std::complex<float> * x, const float * u, float c, std::size_t n) {
+  const float * xr = reinterpret_cast<const float *>(x);
+  float * yr = reinterpret_cast<float *>(y);
+  const __m128 vc = _mm_set1_ps(c);
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    {
+      const __m128 uv = _mm_set_ps(u[i + 1], u[i + 1], u[i], u[i]);
+      _mm_storeu_ps(yr + 2 * i, _mm_add_ps(_mm_loadu_ps(yr + 2 * i), _mm_mul_ps(_mm_mul_ps(vc, _mm_loadu_ps(xr + 2 * i)), uv)));
+    }
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void axpy_diag_sse(std::complex<double> * y, const std::complex<double> * x, const double * u, double c, std::size_t n) {
+  const double * xr = reinterpret_cast<const double *>(x);
+  double * yr = reinterpret_cast<double *>(y);
+  const __m128d vc = _mm_set1_pd(c);
+  for(std::size_t i = 0; i < n; i++)
+    _mm_storeu_pd(yr + 2 * i, _mm_add_pd(_mm_loadu_pd(yr + 2 * i), _mm_mul_pd(_mm_mul_pd(vc, _mm_loadu_pd(xr + 2 * i)), _mm_set1_pd(u[i]))));
+}
+
+__attribute__((target("sse2")))
+inline void axpy_split_sse(float * yr, float * yi, const float * xr, const float * xi, std::complex<float> a, std::size_t n) {
+  const __m128 ar = _mm_set1_ps(a.real()), ai = _mm_set1_ps(a.imag());
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+      const __m128 r = _mm_loadu_ps(xr + i), m = _mm_loadu_ps(xi + i);
+      _mm_storeu_ps(yr + i, _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(yr + i), _mm_mul_ps(ar, r)), _mm_mul_ps(ai, m)));
+      _mm_storeu_ps(yi + i, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(yi + i), _mm_mul_ps(ar, m)), _mm_mul_ps(ai, r)));
+    }
+  axpy_split_scalar(yr + i, yi + i, xr + i, xi + i, a, n - i);
+}
+
+__attribute__((target("sse2")))
+inline void axpy_split_sse(double * yr, double * yi, const double * xr, const double * xi, std::complex<double> a, std::size_t n) {
+  const __m128d ar = _mm_set1_pd(a.real()), ai = _mm_set1_pd(a.imag());
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    {
+      const __m128d r = _mm_loadu_pd(xr + i), m = _mm_loadu_pd(xi + i);
+      _mm_storeu_pd(yr + i, _mm_sub_pd(_mm_add_pd(_mm_loadu_pd(yr + i), _mm_mul_pd(ar, r)), _mm_mul_pd(ai, m)));
+      _mm_storeu_pd(yi + i, _mm_add_pd(_mm_add_pd(_mm_loadu_pd(yi + i), _mm_mul_pd(ar, m)), _mm_mul_pd(ai, r)));
+    }
+  axpy_split_scalar(yr + i, yi + i, xr + i, xi + i, a, n - i);
+}
+
+/* AVX2 + FMA */
+
+__attribute__((target("avx2,fma")))
+inline void axpy_avx2(float * y, const float * x, float a, std::size_t n) {
+  const __m256 va = _mm256_set1_ps(a);
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_avx2(double * y, const double * x, double a, std::size_t n) {
+  const __m256d va = _mm256_set1_pd(a);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(y + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_avx2(std::complex<float> * y, const std::complex<float> * x, std::complex<float> a, std::size_t n) {
+  const float * xr = reinterpret_cast<const float *>(x);
+  float * yr = reinterpret_cast<float *>(y);
+  const __m256 re = _mm256_set1_ps(a.real());
+  const __m256 im = _mm256_set_ps(a.imag(), -a.imag(), a.imag(), -a.imag(), a.imag(), -a.imag(), a.imag(), -a.imag());
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+      const __m256 xv = _mm256_loadu_ps(xr + 2 * i);
+      const __m256 xs = _mm256_permute_ps(xv, 0xB1);
+      _mm256_storeu_ps(yr + 2 * i, _mm256_fmadd_ps(im, xs, _mm256_fmadd_ps(re, xv, _mm256_loadu_ps(yr + 2 * i))));
+    }
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_avx2(std::complex<double> * y, const std::complex<double> * x, std::complex<double> a, std::size_t n) {
+  const double * xr = reinterpret_cast<const double *>(x);
+  double * yr = reinterpret_cast<double *>(y);
+  const __m256d re = _mm256_set1_pd(a.real());
+  const __m256d im = _mm256_set_pd(a.imag(), -a.imag(), a.imag(), -a.imag());
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    {
+      const __m256d xv = _mm256_loadu_pd(xr + 2 * i);
+      const __m256d xs = _mm256_permute_pd(xv, 0x5);
+      _mm256_storeu_pd(yr + 2 * i, _mm256_fmadd_pd(im, xs, _mm256_fmadd_pd(re, xv, _mm256_loadu_pd(yr + 2 * i))));
+    }
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_diag_avx2(float * y, const float * x, const float * u, float c, std::size_t n) {
+  const __m256 vc = _mm256_set1_ps(c);
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(_mm256_mul_ps(vc, _mm256_loadu_ps(x + i)), _mm256_loadu_ps(u + i), _mm256_loadu_ps(y + i)));
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_diag_avx2(double * y, const double * x, const double * u, double c, std::size_t n) {
+  const __m256d vc = _mm256_set1_pd(c);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(y + i, _mm256_fmadd_pd(_mm256_mul_pd(vc, _mm256_loadu_pd(x + i)), _mm256_loadu_pd(u + i), _mm256_loadu_pd(y + i)));
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_diag_avx2(std::complex<float> * y, const std::complex<float> * x, const float * u, float c, std::size_t n) {
+  const float * xr = reinterpret_cast<const float *>(x);
+  float * yr = reinterpret_cast<float *>(y);
+  const __m256 vc = _mm256_set1_ps(c);
+  const __m256i dup = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+      const __m256 uv = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(u + i)), dup);
+      _mm256_storeu_ps(yr + 2 * i, _mm256_fmadd_ps(_mm256_mul_ps(vc, _mm256_loadu_ps(xr + 2 * i)), uv, _mm256_loadu_ps(yr + 2 * i)));
+    }
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_diag_avx2(std::complex<double> * y, const std::complex<double> * x, const double * u, double c, std::size_t n) {
+  const double * xr = reinterpret_cast<const double *>(x);
+  double * yr = reinterpret_cast<double *>(y);
+  const __m256d vc = _mm256_set1_pd(c);
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    {
+      const __m256d uv = _mm256_permute4x64_pd(_mm256_castpd128_pd256(_mm_loadu_pd(u + i)), 0x50);
+      _mm256_storeu_pd(yr + 2 * i, _mm256_fmadd_pd(_mm256_mul_pd(vc, _mm256_loadu_pd(xr + 2 * i)), uv, _mm256_loadu_pd(yr + 2 * i)));
+    }
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_split_avx2(float * yr, float * yi, const float * xr, const float * xi, std::complex<float> a, std::size_t n) {
+  const __m256 ar = _mm256_set1_ps(a.real()), ai = _mm256_set1_ps(a.imag());
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    {
+      const __m256 r = _mm256_loadu_ps(xr + i), m = _mm256_loadu_ps(xi + i);
+      _mm256_storeu_ps(yr + i, _mm256_fnmadd_ps(ai, m, _mm256_fmadd_ps(ar, r, _mm256_loadu_ps(yr + i))));
+      _mm256_storeu_ps(yi + i, _mm256_fmadd_ps(ai, r, _mm256_fmadd_ps(ar, m, _mm256_loadu_ps(yi + i))));
+    }
+  axpy_split_scalar(yr + i, yi + i, xr + i, xi + i, a, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline void axpy_split_avx2(double * yr, double * yi, const double * xr, const double * xi, std::complex<double> a, std::size_t n) {
+  const __m256d ar = _mm256_set1_pd(a.real()), ai = _mm256_set1_pd(a.imag());
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+      const __m256d r = _mm256_loadu_pd(xr + i), m = _mm256_loadu_pd(xi + i);
+      _mm256_storeu_pd(yr + i, _mm256_fnmadd_pd(ai, m, _mm256_fmadd_pd(ar, r, _mm256_loadu_pd(yr + i))));
+      _mm256_storeu_pd(yi + i, _mm256_fmadd_pd(ai, r, _mm256_fmadd_pd(ar, m, _mm256_loadu_pd(yi + i))));
+    }
+  axpy_split_scalar(yr + i, yi + i, xr + i, xi + i, a, n - i);
+}
+
+/* AVX-512 */
+
+__attribute__((target("avx512f")))
+inline void axpy_avx512(float * y, const float * x, float a, std::size_t n) {
+  const __m512 va = _mm512_set1_ps(a);
+  std::size_t i = 0;
+  for(; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_avx512(double * y, const double * x, double a, std::size_t n) {
+  const __m512d va = _mm512_set1_pd(a);
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(y + i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_avx512(std::complex<float> * y, const std::complex<float> * x, std::complex<float> a, std::size_t n) {
+  const float * xr = reinterpret_cast<const float *>(x);
+  float * yr = reinterpret_cast<float *>(y);
+  const float b = a.imag();
+  const __m512 re = _mm512_set1_ps(a.real());
+  const __m512 im = _mm512_set_ps(b, -b, b, -b, b, -b, b, -b, b, -b, b, -b, b, -b, b, -b);
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    {
+      const __m512 xv = _mm512_loadu_ps(xr + 2 * i);
+      const __m512 xs = _mm512_permute_ps(xv, 0xB1);
+      _mm512_storeu_ps(yr + 2 * i, _mm512_fmadd_ps(im, xs, _mm512_fmadd_ps(re, xv, _mm512_loadu_ps(yr + 2 * i))));
+    }
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_avx512(std::complex<double> * y, const std::complex<double> * x, std::complex<double> a, std::size_t n) {
+  const double * xr = reinterpret_cast<const double *>(x);
+  double * yr = reinterpret_cast<double *>(y);
+  const double b = a.imag();
+  const __m512d re = _mm512_set1_pd(a.real());
+  const __m512d im = _mm512_set_pd(b, -b, b, -b, b, -b, b, -b);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+      const __m512d xv = _mm512_loadu_pd(xr + 2 * i);
+      const __m512d xs = _mm512_permute_pd(xv, 0x55);
+      _mm512_storeu_pd(yr + 2 * i, _mm512_fmadd_pd(im, xs, _mm512_fmadd_pd(re, xv, _mm512_loadu_pd(yr + 2 * i))));
+    }
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_diag_avx512(float * y, const float * x, const float * u, float c, std::size_t n) {
+  const __m512 vc = _mm512_set1_ps(c);
+  std::size_t i = 0;
+  for(; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(y + i, _mm512_fmadd_ps(_mm512_mul_ps(vc, _mm512_loadu_ps(x + i)), _mm512_loadu_ps(u + i), _mm512_loadu_ps(y + i)));
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_diag_avx512(double * y, const double * x, const double * u, double c, std::size_t n) {
+  const __m512d vc = _mm512_set1_pd(c);
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(y + i, _mm512_fmadd_pd(_mm512_mul_pd(vc, _mm512_loadu_pd(x + i)), _mm512_loadu_pd(u + i), _mm512_loadu_pd(y + i)));
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_diag_avx512(std::complex<float> * y, const std::complex<float> * x, const float * u, float c, std::size_t n) {
+  const float * xr = reinterpret_cast<const float *>(x);
+  float * yr = reinterpret_cast<float *>(y);
+  const __m512 vc = _mm512_set1_ps(c);
+  const __m512i dup = _mm512_set_epi32(7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0);
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    {
+      const __m512 uv = _mm512_permutexvar_ps(dup, _mm512_castps256_ps512(_mm256_loadu_ps(u + i)));
+      _mm512_storeu_ps(yr + 2 * i, _mm512_fmadd_ps(_mm512_mul_ps(vc, _mm512_loadu_ps(xr + 2 * i)), uv, _mm512_loadu_ps(yr + 2 * i)));
+    }
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_diag_avx512(std::complex<double> * y, const std::complex<double> * x, const double * u, double c, std::size_t n) {
+  const double * xr = reinterpret_cast<const double *>(x);
+  double * yr = reinterpret_cast<double *>(y);
+  const __m512d vc = _mm512_set1_pd(c);
+  const __m512i dup = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+      const __m512d uv = _mm512_permutexvar_pd(dup, _mm512_castpd256_pd512(_mm256_loadu_pd(u + i)));
+      _mm512_storeu_pd(yr + 2 * i, _mm512_fmadd_pd(_mm512_mul_pd(vc, _mm512_loadu_pd(xr + 2 * i)), uv, _mm512_loadu_pd(yr + 2 * i)));
+    }
+  axpy_diag_scalar(y + i, x + i, u + i, c, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_split_avx512(float * yr, float * yi, const float * xr, const float * xi, std::complex<float> a, std::size_t n) {
+  const __m512 ar = _mm512_set1_ps(a.real()), ai = _mm512_set1_ps(a.imag());
+  std::size_t i = 0;
+  for(; i + 16 <= n; i += 16)
+    {
+      const __m512 r = _mm512_loadu_ps(xr + i), m = _mm512_loadu_ps(xi + i);
+      _mm512_storeu_ps(yr + i, _mm512_fnmadd_ps(ai, m, _mm512_fmadd_ps(ar, r, _mm512_loadu_ps(yr + i))));
+      _mm512_storeu_ps(yi + i, _mm512_fmadd_ps(ai, r, _mm512_fmadd_ps(ar, m, _mm512_loadu_ps(yi + i))));
+    }
+  axpy_split_scalar(yr + i, yi + i, xr + i, xi + i, a, n - i);
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_split_avx512(double * yr, double * yi, const double * xr, const double * xi, std::complex<double> a, std::size_t n) {
+  const __m512d ar = _mm512_set1_pd(a.real()), ai = _mm512_set1_pd(a.imag());
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8)
+    {
+      const __m512d r = _mm512_loadu_pd(xr + i), m = _mm512_loadu_pd(xi + i);
+      _mm512_storeu_pd(yr + i, _mm512_fnmadd_pd(ai, m, _mm512_fmadd_pd(ar, r, _mm512_loadu_pd(yr + i))));
+      _mm512_storeu_pd(yi + i, _mm512_fmadd_pd(ai, r, _mm512_fmadd_pd(ar, m, _mm512_loadu_pd(yi + i))));
+    }
+  axpy_split_scalar(yr + i, yi + i, xr + i, xi + i, a, n - i);
+}
+
+#endif
+
+template <typename T>
+struct SimdKernels {
+  /*
+    Kernels acting on the columns of the KPM vectors. The offsets are given in elements,
+    so the same calls work with the interleaved and the split layouts
+  */
+  typedef typename extract_value_type<T>::value_type value_type;
+  std::size_t plane; // Number of elements of a column, the distance between the real and imaginary planes
+  void (*axpy_vec)(T *, const T *, T, std::size_t);
+  void (*axpy_diag_vec)(T *, const T *, const value_type *, value_type, std::size_t);
+  void (*axpy_diag_real)(value_type *, const value_type *, const value_type *, value_type, std::size_t);
+  void (*axpy_split_vec)(value_type *, value_type *, const value_type *, const value_type *, T, std::size_t);
+
+  SimdKernels(std::size_t n) : plane(n), axpy_vec(axpy_scalar<T>), axpy_diag_vec(axpy_diag_scalar<T>),
+			       axpy_diag_real(axpy_diag_scalar<value_type>), axpy_split_vec(axpy_split_scalar<T>) {
+    select(std::integral_constant<bool, std::is_same<value_type, float>::value || std::is_same<value_type, double>::value>());
+  };
+
+  // y[k + i] += a * x[k + d + i] for i < n
+  void axpy(T * y, const T * x, std::size_t k, std::ptrdiff_t d, T a, std::size_t n) const {
+    if(split_layout<T>::value)
+      {
+	value_type * yr = reinterpret_cast<value_type *>(y) + k;
+	const value_type * xr = reinterpret_cast<const value_type *>(x) + k + d;
+	axpy_split_vec(yr, yr + plane, xr, xr + plane, a, n);
+      }
+    else
+      axpy_vec(y + k, x + k + d, a, n);
+  };
+
+  // y[k + i] += c * u[i] * x[k + i] for i < n
+  void axpy_diag(T * y, const T * x, std::size_t k, const value_type * u, value_type c, std::size_t n) const {
+    if(split_layout<T>::value)
+      {
+	value_type * yr = reinterpret_cast<value_type *>(y) + k;
+	const value_type * xr = reinterpret_cast<const value_type *>(x) + k;
+	axpy_diag_real(yr, xr, u, c, n);
+	axpy_diag_real(yr + plane, xr + plane, u, c, n);
+      }
+    else
+      axpy_diag_vec(y + k, x + k, u, c, n);
+  };
+
+  // y[k + i] = c * x[k + i] for i < n
+  void scale(T * y, const T * x, std::size_t k, value_type c, std::size_t n) const {
+    if(split_layout<T>::value)
+      {
+	value_type * yr = reinterpret_cast<value_type *>(y) + k;
+	const value_type * xr = reinterpret_cast<const value_type *>(x) + k;
+	for(std::size_t i = 0; i < n; i++)
+	  {
+	    yr[i] = c * xr[i];
+	    yr[i + plane] = c * xr[i + plane];
+	  }
+      }
+    else
+      for(std::size_t i = k; i < k + n; i++)
+	y[i] = c * x[i];
+  };
+
+  // Access to a single element
+  template <typename U = T>
+  typename std::enable_if<split_layout<U>::value, U>::type get(const T * y, std::size_t e) const {
+    const value_type * yr = reinterpret_cast<const value_type *>(y);
+    return T(yr[e], yr[e + plane]);
+  };
+
+  template <typename U = T>
+  typename std::enable_if<!split_layout<U>::value, U>::type get(const T * y, std::size_t e) const {
+    return y[e];
+  };
+
+  template <typename U = T>
+  typename std::enable_if<split_layout<U>::value, void>::type set(T * y, std::size_t e, T val) const {
+    value_type * yr = reinterpret_cast<value_type *>(y);
+    yr[e] = val.real();
+    yr[e + plane] = val.imag();
+  };
+
+  template <typename U = T>
+  typename std::enable_if<!split_layout<U>::value, void>::type set(T * y, std::size_t e, T val) const {
+    y[e] = val;
+  };
+
+  // sum of conj(x[k + i]) * y[k + i] for i < n, accumulated in the type given by accumulate_type
+  template <typename U = T>
+  typename std::enable_if<split_layout<U>::value, typename accumulate_type<U>::type>::type dot(const T * x, const T * y, std::size_t k, std::size_t n) const {
+    typedef typename accumulate_type<T>::type accumulate;
+    typedef typename extract_value_type<accumulate>::value_type accumulate_value;
+    typedef Eigen::Map<const Eigen::Matrix<value_type, -1, 1>> plane_map;
+    const value_type * xr = reinterpret_cast<const value_type *>(x) + k;
+    const value_type * yr = reinterpret_cast<const value_type *>(y) + k;
+    plane_map ar(xr, n), ai(xr + plane, n), br(yr, n), bi(yr + plane, n);
+    return accumulate(ar.template cast<accumulate_value>().dot(br.template cast<accumulate_value>()) + ai.template cast<accumulate_value>().dot(bi.template cast<accumulate_value>()),
+		      ar.template cast<accumulate_value>().dot(bi.template cast<accumulate_value>()) - ai.template cast<accumulate_value>().dot(br.template cast<accumulate_value>()));
+  };
+
+  template <typename U = T>
+  typename std::enable_if<!split_layout<U>::value, typename accumulate_type<U>::type>::type dot(const T * x, const T * y, std::size_t k, std::size_t n) const {
+    // Eigen conjugates the first argument of dot
+    typedef typename accumulate_type<T>::type accumulate;
+    return Eigen::Map<const Eigen::Matrix<T, -1, 1>>(x + k, n).template cast<accumulate>().dot(Eigen::Map<const Eigen::Matrix<T, -1, 1>>(y + k, n).template cast<accumulate>());
+  };
+
+  // y[ey] += a * x[ex]
+  void add(T * y, std::size_t ey, const T * x, std::size_t ex, T a) const {
+    set(y, ey, get(y, ey) + a * get(x, ex));
+  };
+
+private:
+  void select(std::false_type) {};
+
+  void select(std::true_type) {
+#if SIMD_X86
+    switch(simd_level()) {
+    case 3:
+      axpy_vec = axpy_avx512;
+      axpy_diag_vec = axpy_diag_avx512;
+      axpy_diag_real = axpy_diag_avx512;
+      break;
+    case 2:
+      axpy_vec = axpy_avx2;
+      axpy_diag_vec = axpy_diag_avx2;
+      axpy_diag_real = axpy_diag_avx2;
+      break;
+    case 1:
+      axpy_vec = axpy_sse;
+      axpy_diag_vec = axpy_diag_sse;
+      axpy_diag_real = axpy_diag_sse;
+      break;
+    }
+#endif
+    select_split(std::integral_constant<bool, is_tt<std::complex, T>::value>());
+  };
+
+  void select_split(std::false_type) {};
+
+  void select_split(std::true_type) {
+#if SIMD_X86
+    switch(simd_level()) {
+    case 3:
+      axpy_split_vec = axpy_split_avx512;
+      break;
+    case 2:
+      axpy_split_vec = axpy_split_avx2;
+      break;
+    case 1:
+      axpy_split_vec = axpy_split_sse;
+      break;
+    }
+#endif
+  };
+};
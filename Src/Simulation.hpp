@@ -22,6 +22,7 @@ template <typename T,unsigned D>
 class GlobalSimulation {
 private:
   GLOBAL_VARIABLES <T> Global;
+  Configuration<T,D>   config;   // Read once here and shared by all the threads
   LatticeStructure <D> rglobal;
   
   
@@ -30,18 +31,94 @@ private:
   double EnergyScale;
 
 public:
-  GlobalSimulation( char *name ) : rglobal(name)
+  GlobalSimulation( char *name ) : config(name), rglobal(config)
   {
     debug_message("Entered global_simulation\n");
-    Global.ghosts.resize( rglobal.get_BorderSize() );
-    std::fill(Global.ghosts.begin(), Global.ghosts.end(), 0);
+    if(rglobal.MagneticField != 0 && !is_tt<std::complex, T>::value){
+      std::cout << "The magnetic field needs a complex Hamiltonian (IS_COMPLEX = 1). Exiting.\n";
+      exit(1);
+    }
     
     // Regular quantities to calculate, such as DOS and CondXX
     H5::H5File * file         = new H5::H5File(name, H5F_ACC_RDONLY);
 
     // Fetch the energy scale
     get_hdf5<double>(&EnergyScale,  file, (char *)   "/EnergyScale");
+    
+    // Number of random vectors iterated together. This is optional, by default
+    // each random vector runs through its own Chebyshev recursion
+    Global.block_size = 1;
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<unsigned>(&Global.block_size, file, (char *) "/BlockSize");
+    } catch(H5::Exception& e) {debug_message("BlockSize not found, using a single random vector per recursion.\n");}
+    
+    // Number of KPM vectors stored in the memory while calculating Gamma2D. This is optional
+    Global.memory = MEMORY;
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<int>(&Global.memory, file, (char *) "/Memory");
+    } catch(H5::Exception& e) {debug_message("Memory not found, using the default.\n");}
+    
+    // Memory in MB for the KPM vectors of Gamma2D in all the threads. This is optional, and when it is
+    // given the number of vectors stored is the largest that fits in it, instead of Memory
+    double budget = MEMORY_BUDGET;
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<double>(&budget, file, (char *) "/MemoryBudget");
+    } catch(H5::Exception& e) {debug_message("MemoryBudget not found, using the default.\n");}
+    Global.memory_budget = std::size_t(std::max(budget, 0.) * 1024 * 1024);
+    
+    // Size of the tiles swept by the KPM iteration. This is optional, and 0 means
+    // that the fastest size for this lattice is chosen before the calculations start
+    unsigned stride = STRIDE;
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<unsigned>(&stride, file, (char *) "/Stride");
+    } catch(H5::Exception& e) {debug_message("Stride not found, using the default.\n");}
+    Global.stride = stride;
+    
+    // Seed of the random numbers. This is optional, and without it a new seed is drawn,
+    // which is printed so that the run can be repeated
+    unsigned long long seed;
+    try{
+      H5::Exception::dontPrint();
+      get_hdf5<unsigned long long>(&seed, file, (char *) "/Seed");
+    } catch(H5::Exception& e) {
+      std::random_device rd;
+      seed = (static_cast<unsigned long long>(rd()) << 32) | rd();
+      std::cout << "Seed of the random numbers: " << seed << "\n";
+    }
+    Global.seed = seed;
     delete file;
+    
+    if(Global.block_size < 1){
+      std::cout << "The number of random vectors in each block (BlockSize) must be at least 1. Exiting.\n";
+      exit(1);
+    }
+    
+    // The Chebyshev recursion of Gamma3D runs on the vectors stored in the memory, and needs two of them
+    if(Global.memory < 2){
+      std::cout << "The number of KPM vectors stored in the memory (Memory) must be at least 2. Exiting.\n";
+      exit(1);
+    }
+    
+    // Flags of the exchange of the ghosts between the threads
+#if DIRECT_GHOSTS
+    // The threads read them from the vectors of their neighbours
+    Global.ghost_columns.assign(rglobal.n_threads * D, nullptr);
+    Global.exchange_acks.assign(rglobal.n_threads * D * Global.flag_stride, 0);
+#else
+    // The buffers are allocated by each thread in its Simulation
+    Global.ghosts.resize(rglobal.n_threads);
+#endif
+    Global.exchange_flags.assign(rglobal.n_threads * D * Global.flag_stride, 0);
+    
+    // Each thread sends the broken defects to its neighbours along and across the sides of its domain
+    Global.outbox.resize(rglobal.n_threads * std::size_t(std::pow(3, D)));
+    
+    // Parts of the samples and of the norms of the KPM vectors published by each thread
+    Global.statistics.parts.assign(rglobal.n_threads, nullptr);
 
     
     
@@ -55,10 +132,14 @@ public:
 	
     
     omp_set_num_threads(rglobal.n_threads);
+    if(Global.stride == 0)
+      Global.stride = autotune_stride(name);
+    
     debug_message("Starting parallelization\n");
 #pragma omp parallel default(shared)
     {
-      Simulation<T,D> simul(name, Global);
+      pin_thread(omp_get_thread_num(), rglobal.n_threads);
+      Simulation<T,D> simul(name, Global, config);
       
       // Measure the average time it takes to run a multiplication
       // This will allow us to obtain an estimate for the time it'll take
@@ -92,7 +173,7 @@ public:
           
           // obtain the times for the normal queue
           for(unsigned int i = 0; i < queue.size(); i++){
-            queue.at(i).embed_time(Global.kpm_iteration_time);
+            queue.at(i).embed_time(Global.kpm_iteration_time, simul.gamma_multiplications(queue.at(i)));
             queue_time += queue.at(i).time_length;
           }
 
@@ -125,6 +206,57 @@ public:
     }
     debug_message("Left global_simulation\n");
   };
+  
+  std::size_t autotune_stride(char *name) {
+    /*
+      Times a few Chebyshev iterations on the actual lattice with each size
+      of the tiles from 8 to 256, and returns the fastest one. The sizes larger
+      than the sub-domains give the same tiles and are not tested
+    */
+    const int N_average = 10;
+    std::size_t max_length = 0;
+    for(unsigned i = 0; i < D; i++)
+      max_length = std::max(max_length, std::size_t(rglobal.ld[i]));
+    
+    std::vector<std::size_t> candidates;
+    for(std::size_t stride = 8; stride <= 256; stride *= 2)
+      {
+        candidates.push_back(stride);
+        if(stride >= max_length)
+          break;
+      }
+    
+    std::vector<double> times(candidates.size());
+    verbose_message("Choosing the size of the tiles:\n");
+#pragma omp parallel default(shared)
+    {
+      pin_thread(omp_get_thread_num(), rglobal.n_threads);
+      for(unsigned i = 0; i < candidates.size(); i++)
+        {
+#pragma omp master
+          Global.stride = candidates.at(i);
+#pragma omp barrier
+          Simulation<T,D> trial(name, Global, config);
+          // The trials are timed with a realization of the disorder, as in the calculations
+          trial.h.generate_disorder();
+          double time = trial.time_kpm(N_average);
+#pragma omp master
+          times.at(i) = time;
+#pragma omp barrier
+        }
+    }
+    
+    unsigned best = 0;
+    for(unsigned i = 0; i < candidates.size(); i++)
+      {
+        verbose_message("  stride "); verbose_message(candidates.at(i)); verbose_message(": ");
+        verbose_message(times.at(i)); verbose_message(" s per iteration\n");
+        if(times.at(i) < times.at(best))
+          best = i;
+      }
+    verbose_message("Using stride "); verbose_message(candidates.at(best)); verbose_message("\n\n");
+    return candidates.at(best);
+  };
 };
 #endif
 
@@ -134,13 +266,26 @@ class Simulation  {
 public:
   KPMRandom <T>          rnd;
   std::vector<T>         ghosts;
+  KPM_Arena <T>          arena;  // Storage of the KPM vectors of this thread
   LatticeStructure <D>   r;      
   GLOBAL_VARIABLES <T> & Global;
   char                 * name;
+  const Configuration<T,D> & config;
   Hamiltonian<T,D>       h;
-  Simulation(char *filename, GLOBAL_VARIABLES <T> & Global1): r(filename),  Global(Global1), name(filename), h(*this)  {
-    rnd.init_random();
-    ghosts.resize(Global.ghosts.size()/r.n_threads);
+  typedef typename accumulate_type<T>::type accumulate; // Type of the products between KPM vectors and of the moments
+  typedef typename extract_value_type<accumulate>::value_type accumulate_value;
+  std::vector<accumulate> norms;        // Norms recorded in the current sample, checked by check_norms
+  std::vector<int>        norm_moments; // Moments of the recorded norms
+  Simulation(char *filename, GLOBAL_VARIABLES <T> & Global1, const Configuration<T,D> & config1): r(config1, Global1.stride),  Global(Global1), name(filename), config(config1), h(*this)  {
+    rnd.init_random(Global.seed);
+#if !DIRECT_GHOSTS
+    // Each thread has two buffers along each direction, used in alternate exchanges, so that it can
+    // send the next faces while its neighbours are still reading the previous ones. They are
+    // allocated here by the thread that writes them, to be placed in the memory of its socket.
+    // The ghosts of every vector of the block are exchanged at the same time
+    ghosts.resize(r.get_BorderSize() * Global.block_size / r.n_threads);
+    Global.ghosts.at(r.thread_id).assign(ghosts.size() * 2 * D, 0);
+#endif
   };
   
   
@@ -235,16 +380,22 @@ public:
       exit(1);
     }
     
-    if(dim == 2 and MEMORY > 2){
-      if(N_moments.at(0)%MEMORY!=0 or N_moments.at(1)%MEMORY!=0){
+    int memory = (dim == 2 ? moments_in_memory(NRandomV, N_moments) : Global.memory);
+    // Gamma2D and Gamma3D keep groups of Memory moments along the first two indexes
+    if((dim == 2 or dim == 3) and memory > 2){
+      if(N_moments.at(0)%memory!=0 or N_moments.at(1)%memory!=0){
         std::cout << "The number of Chebyshev moments ("<< N_moments.at(0)<<","<< N_moments.at(1)<<")"; 
-        std::cout << "has to be a multiple of MEMORY ("<< MEMORY <<"). Exiting.\n";
+        std::cout << "has to be a multiple of Memory ("<< memory <<"). Exiting.\n";
         exit(1);
       }
-      Gamma2D(NRandomV, NDisorder, N_moments, indices, name_dataset);
+    }
+    if(dim == 2 and memory > 2){
+      Gamma2D(NRandomV, NDisorder, N_moments, indices, name_dataset, memory);
     } else {
       if(dim == 3){
         Gamma3D(NRandomV, NDisorder, N_moments, indices, name_dataset);
+      } else if(dim == 1 and indices.at(0).size() == 0){
+        Gamma1D(NRandomV, NDisorder, N_moments, indices, name_dataset);
       } else {
         GammaGeneral(NRandomV, NDisorder, N_moments, indices, name_dataset);
       }
@@ -254,19 +405,93 @@ public:
     debug_message("Left Measure_Gamma\n");
   }
 	
+  int moments_in_memory(int NRandomV, const std::vector<int> & N_moments, bool verbose = true){
+    /*
+      Number of KPM vectors stored by Gamma2D. The right recursion is repeated once for each
+      group of memory left vectors, and the products of the groups are a matrix product with
+      memory x memory elements, so storing many vectors cuts the multiplications by the
+      Hamiltonian and makes the products efficient. With a memory budget, the number is the
+      largest that fits in it and divides both numbers of moments. The messages synchronize
+      the threads, so they are left out when only the master thread calls it.
+    */
+    if(Global.memory_budget == 0)
+      return Global.memory;
+    
+    // Gamma2D keeps two vectors of memory columns, each one with a block of random vectors
+    const unsigned nblock = std::min(Global.block_size, unsigned(NRandomV));
+    const std::size_t column = r.Sized * nblock * sizeof(T);
+    const std::size_t fit = Global.memory_budget / r.n_threads / (2 * column);
+    int memory = int(std::min(fit, std::size_t(std::max(N_moments.at(0), N_moments.at(1)))));
+    for(; memory > 2; memory--)
+      if(N_moments.at(0) % memory == 0 and N_moments.at(1) % memory == 0)
+        break;
+    
+    if(memory <= 2){
+      if(verbose){
+#pragma omp master
+        std::cout << "Warning: the memory budget is too small for the KPM vectors of Gamma2D, using Memory ("
+                  << Global.memory << ").\n" << std::flush;
+      }
+      return Global.memory;
+    }
+    if(verbose){
+      verbose_message("Number of KPM vectors stored in the memory: "); verbose_message(memory); verbose_message("\n");
+    }
+    return memory;
+  };
+
+  bool symmetric_gamma(const std::vector<std::vector<unsigned>> & indices, const std::vector<int> & N_moments){
+    // Gamma2D only calculates half of the longitudinal Gamma matrices, see below
+    return SYMMETRIC_GAMMA && indices.at(0) == indices.at(1) && N_moments.at(0) == N_moments.at(1);
+  };
+
+  double gamma_multiplications(const measurement_queue & queue){
+    /*
+      Number of multiplications by the Hamiltonian of each random vector in Measure_Gamma, used
+      to estimate its time. It follows the choice of the function made in Measure_Gamma
+    */
+    std::vector<std::vector<unsigned>> indices = process_string(queue.direction_string);
+    const std::vector<int> & N = queue.NMoments;
+    if(indices.size() != N.size())
+      return 0;
+    
+    const int dim = N.size();
+    const int memory = (dim == 2 ? moments_in_memory(queue.NRandom, N, false) : Global.memory);
+    if(dim == 2 and memory > 2){
+      // The left recursion runs once and the right one once for each group of left moments,
+      // only up to that group for the symmetric matrices
+      const double groups = N.at(0)/memory;
+      if(symmetric_gamma(indices, N))
+        return N.at(0) + memory*groups*(groups + 1)/2;
+      return N.at(0) + groups*N.at(1);
+    }
+    if(dim == 3)
+      return N.at(0) + double(N.at(0)/memory)*N.at(2)*(N.at(1) + 1);
+    if(dim == 1 and indices.at(0).size() == 0)
+      return N.at(0)/2;                 // Gamma1D gets two moments from each multiplication
+    
+    // GammaGeneral repeats the recursions of the inner moments for each outer moment
+    double multiplications = 0, product = 1;
+    for(int i = 0; i < dim; i++){
+      product *= N.at(i);
+      multiplications += product;
+    }
+    return multiplications;
+  };
+  
   void Gamma2D(int NRandomV, int NDisorder, std::vector<int> N_moments, 
-      std::vector<std::vector<unsigned>> indices, std::string name_dataset){
+      std::vector<std::vector<unsigned>> indices, std::string name_dataset, int memory){
     // This function calculates all the kinds of one-dimensional Gamma matrices
     // such as Tr[Tn]    Tr[v^xx Tn]     etc
 
-    typedef typename extract_value_type<T>::value_type value_type;
-
     //  --------- INITIALIZATIONS --------------
     
-    KPM_Vector<T,D> kpm0(1, *this);      // initial random vector
-    KPM_Vector<T,D> kpm1(2, *this); // left vector that will be Chebyshev-iterated on
-    KPM_Vector<T,D> kpm2(MEMORY, *this); // right vector that will be Chebyshev-iterated on
-		KPM_Vector<T,D> kpm3(MEMORY, *this); // kpm1 multiplied by the velocity
+    // Each KPM vector holds a block of nblock random vectors, iterated together
+    unsigned nblock = std::min(Global.block_size, unsigned(NRandomV));
+    KPM_Vector<T,D> kpm0(1, *this, nblock);      // initial random vector
+    KPM_Vector<T,D> kpm1(2, *this, nblock); // left vector that will be Chebyshev-iterated on
+    KPM_Vector<T,D> kpm2(memory, *this, nblock); // right vector that will be Chebyshev-iterated on
+		KPM_Vector<T,D> kpm3(memory, *this, nblock); // kpm1 multiplied by the velocity
 
     // initialize the local gamma matrix and set it to 0
     int size_gamma = 1;
@@ -279,7 +504,17 @@ public:
     }
 
     //std::cout << "############ size gamma: " << size_gamma << "\n";
-    Eigen::Array<T, -1, -1> gamma = Eigen::Array<T, -1, -1 >::Zero(1, size_gamma);
+    // Gamma matrix of the current block of random vectors, in the domain of this thread
+    Eigen::Array<accumulate, -1, -1> gamma = Eigen::Array<accumulate, -1, -1 >::Zero(1, size_gamma);
+    start_statistics(size_gamma);
+    
+    /*
+      When both velocities are the same, as in Gamma^{x,x}, the average of the Gamma matrix is
+      hermitian: Tr[v Tn v Tm] = conj(Tr[v Tm v Tn]). Then only the products of the right groups
+      of moments m up to the left group n are calculated, which also stops the right recursion
+      at the group n, and the entries with m > n are found from the conjugates of those with m < n
+    */
+    const bool symmetric = symmetric_gamma(indices, N_moments);
  
     // finished initializations
 
@@ -287,36 +522,41 @@ public:
     
     
     // start the kpm iteration
-    long average = 0;
+    bool diverged = false;
     for(int disorder = 0; disorder < NDisorder; disorder++){
       h.generate_disorder();
       for(unsigned it = 0; it < indices.size(); it++)
         h.build_velocity(indices.at(it), it);
-      for(int randV = 0; randV < NRandomV; randV++){
+      for(int randV = 0; randV < NRandomV; randV += nblock){
         
-
-        kpm0.initiate_vector();			// original random vector. This sets the index to zero
+        // number of random vectors of this block that enter the average
+        int nactive = std::min(int(nblock), NRandomV - randV);
+        kpm0.initiate_vector(nactive);			// original random vector. This sets the index to zero
         kpm0.Exchange_Boundaries();
 	      kpm1.set_index(0);
 
         generalized_velocity(&kpm1, &kpm0, indices, 0);
+        accumulate left_norm = kpm1.interior_product(0, 0);
+        accumulate right_norm = kpm0.interior_product(0, 0);
+        int checked = 0;             // Last moment of the right recursion whose norm was checked
         
-        // run through the left loop MEMORY iterations at a time
-        for(int n = 0; n < N_moments.at(0); n+=MEMORY){
+        // run through the left loop memory iterations at a time
+        for(int n = 0; n < N_moments.at(0); n+=memory){
           
-          // Iterate MEMORY times. The first time this occurs, we must exclude the zeroth
+          // Iterate memory times. The first time this occurs, we must exclude the zeroth
           // case, because it is already calculated, it's the identity
-          for(int i = n; i < n + MEMORY; i++){
+          for(int i = n; i < n + memory; i++){
             //std::cout << "left i:" << i << " n:" << n << "\n";
             if(i!=0){
               //std::cout << "inside left\n";
               cheb_iteration(&kpm1, i-1);
+              check_recursion(&kpm1, i, left_norm);
               //std::cout << "index: " << kpm1.get_index() << "\n";
             }
 
-            kpm3.set_index(i%MEMORY);
+            kpm3.set_index(i%memory);
             generalized_velocity(&kpm3, &kpm1, indices, 1);
-            kpm3.empty_ghosts(i%MEMORY);
+            kpm3.empty_ghosts(i%memory);
             
             //std::cout << "index3: " << kpm3.get_index() << "\n";
           }
@@ -324,36 +564,49 @@ public:
           // copy the |0> vector to |kpm2>
           kpm2.set_index(0);
           kpm2.v.col(0) = kpm0.v.col(0);
-          for(int m = 0; m < N_moments.at(1); m+=MEMORY){
+          int last = (symmetric ? n + memory : N_moments.at(1));
+          for(int m = 0; m < last; m+=memory){
 
-            // iterate MEMORY times, just like before. No need to multiply by v here
-            for(int i = m; i < m + MEMORY; i++){
+            // iterate memory times, just like before. No need to multiply by v here
+            for(int i = m; i < m + memory; i++){
               //std::cout << "right i:" << i << " m:" << m << "\n";
               if(i!=0){
                 //std::cout << "inside right\n";
                 cheb_iteration(&kpm2, i-1);
+                // The right recursion is repeated for each left group, its norms are only checked once
+                if(i > checked){
+                  check_recursion(&kpm2, i, right_norm);
+                  checked = i;
+                }
               //std::cout << "index2: " << kpm2.get_index() << "\n";
               }
             }
             
-            // Finally, do the matrix product and store the result in the Gamma matrix
-            Eigen::Matrix<T, -1, -1> kpm_product;
-            kpm_product = Eigen::Matrix<T, -1, -1>::Zero(MEMORY, MEMORY); // this line is not necessary
-            kpm_product = kpm3.v.adjoint() * kpm2.v; 
-            Eigen::Matrix<T, -1, -1> flatten;
-            flatten = Eigen::Matrix<T,-1,-1>::Zero(1, 1);
-            for(int i = 0; i < MEMORY; i++)
-              for(int j = 0; j < MEMORY; j++){
-                flatten(0) = kpm_product(i,j);
-                gamma.matrix().block(0,(n+i)*N_moments.at(0) + m + j, 1, 1) +=
-                  (flatten - gamma.matrix().block(0,(n+i)*N_moments.at(0) + m + j,1,1))/value_type(average + 1);			
-              }
+            // Finally, do the matrix product and store the result in the Gamma matrix.
+            // The product sums the contributions of all the vectors of the block
+            Eigen::Matrix<accumulate, -1, -1> kpm_product = kpm3.adjoint_product(kpm2); 
+            for(int i = 0; i < memory; i++){
+              // The moments m..m+memory of the left moment n+i are contiguous in gamma
+              auto row = gamma.matrix().block(0, (n+i)*N_moments.at(0) + m, 1, memory);
+              row = kpm_product.row(i);
+            }
           }
         }
-        average++;
+        
+        if(symmetric){
+          // The rows are the right moments and the columns the left ones. The entries with the
+          // right moment after the left one are the conjugates of the calculated ones, also inside
+          // the diagonal blocks, so that the sample does not depend on the memory
+          Eigen::Map<Eigen::Matrix<accumulate, -1, -1>> g(gamma.data(), N_moments.at(1), N_moments.at(0));
+          for(int n = 0; n < N_moments.at(0); n++)
+            for(int m = n + 1; m < N_moments.at(1); m++)
+              g(m, n) = Eigen::numext::conj(g(n, m));
+        }
+        check_norms(diverged);
+        add_sample(gamma, nactive, N_moments, indices);
       }
     } 
-    store_gamma(&gamma, N_moments, indices, name_dataset);
+    store_gamma(N_moments, indices, name_dataset);
   };
 
 
@@ -362,15 +615,13 @@ public:
     // This function calculates all the kinds of one-dimensional Gamma matrices
     // such as Tr[Tn]    Tr[v^xx Tn]     etc
 
-    typedef typename extract_value_type<T>::value_type value_type;
-
     //  --------- INITIALIZATIONS --------------
     
     KPM_Vector<T,D> kpm0(1, *this);           // initial random vector
     KPM_Vector<T,D> kpm_Vn(2, *this);          // left vector that will be Chebyshev-iterated on
-		KPM_Vector<T,D> kpm_VnV(MEMORY, *this);    // kpmL multiplied by the velocity
+		KPM_Vector<T,D> kpm_VnV(Global.memory, *this);    // kpmL multiplied by the velocity
     KPM_Vector<T,D> kpm_p(2, *this);          // right-most vector that will be Chebyshev-iterated on
-    KPM_Vector<T,D> kpm_pVm(MEMORY, *this);         // middle vector that will be Chebyshev-iterated on
+    KPM_Vector<T,D> kpm_pVm(Global.memory, *this);         // middle vector that will be Chebyshev-iterated on
 
     // initialize the local gamma matrix and set it to 0
     int size_gamma = 1;
@@ -381,12 +632,14 @@ public:
       }
       size_gamma *= N_moments.at(i);
     }
-    Eigen::Array<T, -1, -1> gamma = Eigen::Array<T, -1, -1 >::Zero(1, size_gamma);
+    // Gamma matrix of the current random vector, in the domain of this thread
+    Eigen::Array<accumulate, -1, -1> gamma = Eigen::Array<accumulate, -1, -1 >::Zero(1, size_gamma);
+    start_statistics(size_gamma);
  
     // finished initializations
     
     // start the kpm iteration
-    long average = 0;
+    bool diverged = false;
     for(int disorder = 0; disorder < NDisorder; disorder++){
 
       // Distribute the disorder and update the velocity matrices
@@ -402,40 +655,50 @@ public:
 	      kpm_Vn.set_index(0);
 
         generalized_velocity(&kpm_Vn, &kpm0, indices, 0);
+        accumulate left_norm = kpm_Vn.interior_product(0, 0);
+        accumulate right_norm = kpm0.interior_product(0, 0);
         
-        for(int n = 0; n < N_moments.at(0); n+=MEMORY){
+        for(int n = 0; n < N_moments.at(0); n+=Global.memory){
 
           // Calculation of the left kpm vector
-          for(int ni = n; ni < n + MEMORY; ni++){
-            if(ni!=0) cheb_iteration(&kpm_Vn, ni-1);
+          for(int ni = n; ni < n + Global.memory; ni++){
+            if(ni!=0){
+              cheb_iteration(&kpm_Vn, ni-1);
+              check_recursion(&kpm_Vn, ni, left_norm);
+            }
            
-            kpm_VnV.set_index(ni%MEMORY);
+            kpm_VnV.set_index(ni%Global.memory);
             generalized_velocity(&kpm_VnV, &kpm_Vn, indices, 0);
-            kpm_VnV.empty_ghosts(ni%MEMORY);
+            kpm_VnV.empty_ghosts(ni%Global.memory);
           }
           
           // Calculation of the right kpm vector
           kpm_p.set_index(0);
           kpm_p.v.col(0) = kpm0.v.col(0);
           for(int p = 0; p < N_moments.at(2); p++){
-            if(p!=0) cheb_iteration(&kpm_p, p-1);
+            if(p!=0){
+              cheb_iteration(&kpm_p, p-1);
+              // The right recursion is repeated for each left group, its norms are only checked once
+              if(n == 0)
+                check_recursion(&kpm_p, p, right_norm);
+            }
             
             kpm_pVm.set_index(0);
             generalized_velocity(&kpm_pVm, &kpm_p, indices, 2);
-            for(int m = 0; m < N_moments.at(1); m += MEMORY){
-              for(int mi = m; mi < m + MEMORY; mi++)
+            for(int m = 0; m < N_moments.at(1); m += Global.memory){
+              for(int mi = m; mi < m + Global.memory; mi++)
                 if(mi != 0) cheb_iteration(&kpm_pVm, mi-1);
 
               
-              Eigen::Matrix<T, -1, -1> kpm_product;
-              kpm_product = Eigen::Matrix<T, -1, -1>::Zero(MEMORY, MEMORY); // this line is not necessary
-              kpm_product = kpm_VnV.v.adjoint() * kpm_pVm.v; 
+              Eigen::Matrix<accumulate, -1, -1> kpm_product;
+              kpm_product = Eigen::Matrix<accumulate, -1, -1>::Zero(Global.memory, Global.memory); // this line is not necessary
+              kpm_product = kpm_VnV.adjoint_product(kpm_pVm); 
 
               long int index;
-              for(int i = 0; i < MEMORY; i++)
-                for(int j = 0; j < MEMORY; j++){
+              for(int i = 0; i < Global.memory; i++)
+                for(int j = 0; j < Global.memory; j++){
                   index = p*N_moments.at(1)*N_moments.at(0) + (m+j)*N_moments.at(0) + n+i;
-                  gamma(index) += (kpm_product(i, j) - gamma(index))/value_type(average + 1);
+                  gamma(index) = kpm_product(i, j);
 #pragma omp master
                   {
                     std::cout << "thread: "<< omp_get_thread_num();
@@ -446,12 +709,72 @@ public:
             }
           }
         }
-        average++;
+        check_norms(diverged);
+        add_sample(gamma, 1, N_moments, indices);
       }
     } 
-    store_gamma(&gamma, N_moments, indices, name_dataset);
+    store_gamma(N_moments, indices, name_dataset);
   };
 
+  void Gamma1D(int NRandomV, int NDisorder, std::vector<int> N_moments,
+      std::vector<std::vector<unsigned>> indices, std::string name_dataset){
+    /*
+      Moments of the identity, mu_n = <0|T_n(H)|0>, with half of the multiplications
+      by the Hamiltonian. With |n> = T_n(H)|0> and T_m T_n = (T_{m+n} + T_{|m-n|})/2,
+      
+      mu_{2n}   = 2 <n|n>   - mu_0
+      mu_{2n+1} = 2 <n+1|n> - mu_1
+    */
+    const int N = N_moments.at(0);
+    
+    // The vector holds |n> and |n-1>, with a block of nblock random vectors
+    unsigned nblock = std::min(Global.block_size, unsigned(NRandomV));
+    KPM_Vector<T,D> kpm(2, *this, nblock);
+    
+    // Moments of the current block of random vectors, in the domain of this thread
+    Eigen::Array<accumulate, -1, -1> mu(1, N);
+    start_statistics(N);
+    
+    bool diverged = false;
+    for(int disorder = 0; disorder < NDisorder; disorder++){
+      h.generate_disorder();
+      
+      for(int randV = 0; randV < NRandomV; randV += nblock){
+        
+        // The products sum over the nactive vectors of the block
+        int nactive = std::min(int(nblock), NRandomV - randV);
+        kpm.initiate_vector(nactive);
+        kpm.set_index(0);
+        kpm.Exchange_Boundaries();
+        
+        mu(0) = kpm.interior_product(0, 0);
+        if(N > 1){
+          kpm.template Multiply<0>();
+          mu(1) = kpm.interior_product(1, 0);
+        }
+        
+        for(int n = 1; 2*n < N; n++){
+          // |n> is the current column and |n-1> the other one
+          int current = kpm.get_index();
+          accumulate norm = kpm.interior_product(current, current);
+          mu(2*n) = accumulate_value(2)*norm - mu(0);
+          
+          if(norm_check(2*n))
+            record_norm(norm, mu(0), 2*n);
+          if(2*n + 1 < N){
+            kpm.template Multiply<1>();
+            mu(2*n + 1) = accumulate_value(2)*kpm.interior_product(kpm.get_index(), current) - mu(1);
+          }
+        }
+        
+        check_norms(diverged);
+        add_sample(mu, nactive, N_moments, indices);
+      }
+    }
+    
+    store_gamma(N_moments, indices, name_dataset);
+  }
+
   void GammaGeneral(int NRandomV, int NDisorder, std::vector<int> N_moments,
       std::vector<std::vector<unsigned>> indices, std::string name_dataset){
     
@@ -474,29 +797,33 @@ public:
     }
 		
 		
-    // Initialize the KPM vectors that will be needed to run the program 
+    // Initialize the KPM vectors that will be needed to run the program.
+    // Each of them holds a block of nblock random vectors
+    unsigned nblock = std::min(Global.block_size, unsigned(NRandomV));
     std::vector<KPM_Vector<T,D>*> kpm_vector(dim+1);
-    kpm_vector.at(0) = new KPM_Vector<T,D> (1, *this);
+    kpm_vector.at(0) = new KPM_Vector<T,D> (1, *this, nblock);
     for(int i = 0; i < dim; i++)
-		  kpm_vector.at(i+1) = new KPM_Vector<T,D> (2, *this);
+		  kpm_vector.at(i+1) = new KPM_Vector<T,D> (2, *this, nblock);
 		
 		
     // Define some pointers to make the code easier to read
     KPM_Vector<T,D> *kpm0 = kpm_vector.at(0);
     KPM_Vector<T,D> *kpm1 = kpm_vector.at(1);
 			
-    // Make sure the local gamma matrix is zeroed
-    Eigen::Array<T, -1, -1> gamma = Eigen::Array<T, -1, -1 >::Zero(1, size_gamma);
+    // Gamma matrix of the current block of random vectors, in the domain of this thread
+    Eigen::Array<accumulate, -1, -1> gamma = Eigen::Array<accumulate, -1, -1 >::Zero(1, size_gamma);
+    start_statistics(size_gamma);
 
-    long average = 0;
+    bool diverged = false;
     for(int disorder = 0; disorder < NDisorder; disorder++){
       h.generate_disorder();
       for(unsigned it = 0; it < indices.size(); it++)
         h.build_velocity(indices.at(it), it);
 
-      for(int randV = 0; randV < NRandomV; randV++){
+      for(int randV = 0; randV < NRandomV; randV += nblock){
         
-        kpm0->initiate_vector();			// original random vector
+        int nactive = std::min(int(nblock), NRandomV - randV);
+        kpm0->initiate_vector(nactive);			// original random vector
         kpm1->set_index(0);
         kpm1->v.col(0) = kpm0->v.col(0);
         kpm1->Exchange_Boundaries();
@@ -508,13 +835,14 @@ public:
 
         kpm0->empty_ghosts(0);
         long index_gamma = 0;
-        recursive_KPM(1, dim, N_moments, &average, &index_gamma, indices, &kpm_vector, &gamma);
-      	average++;
+        recursive_KPM(1, dim, N_moments, &index_gamma, indices, &kpm_vector, &gamma);
+        check_norms(diverged);
+        add_sample(gamma, nactive, N_moments, indices);
       }
     } 
 		
 		
-    store_gamma(&gamma, N_moments, indices, name_dataset);
+    store_gamma(N_moments, indices, name_dataset);
 		
     // delete the kpm_vector
     delete kpm_vector.at(0);
@@ -523,10 +851,9 @@ public:
 	
   }
 
-  void recursive_KPM(int depth, int max_depth, std::vector<int> N_moments, long *average, long *index_gamma, 
-      std::vector<std::vector<unsigned>> indices, std::vector<KPM_Vector<T,D>*> *kpm_vector, Eigen::Array<T, -1, -1> *gamma){
+  void recursive_KPM(int depth, int max_depth, std::vector<int> N_moments, long *index_gamma, 
+      std::vector<std::vector<unsigned>> indices, std::vector<KPM_Vector<T,D>*> *kpm_vector, Eigen::Array<accumulate, -1, -1> *gamma){
     debug_message("Entered recursive_KPM\n");
-    typedef typename extract_value_type<T>::value_type value_type;
 		
 		
     if(depth != max_depth){
@@ -539,6 +866,10 @@ public:
       //std::cout << "first branch. Depth: " << depth << "\n" << std::flush;
 			
 			
+      // Only the outermost recursion runs once for each sample, its norms are the ones checked
+      accumulate reference = 0;
+      if(depth == 1)
+        reference = kpm1->interior_product(kpm1->get_index(), kpm1->get_index());
       for(int p = 0; p < N_moments.at(depth - 1); p++){
         kpm2->set_index(0);
         switch(indices.at(depth).size()){
@@ -551,27 +882,35 @@ public:
           kpm2->Velocity(kpm2data, kpm1data, max_depth - depth); 											
         }
 				
-        recursive_KPM(depth + 1, max_depth, N_moments, average, index_gamma, indices, kpm_vector, gamma);
+        recursive_KPM(depth + 1, max_depth, N_moments, index_gamma, indices, kpm_vector, gamma);
         if(p == 0){
           kpm1->template Multiply<0>(); 
         }
         else if(p < N_moments.at(depth-1) - 1){
           kpm1->template Multiply<1>(); 
         }
+        if(depth == 1 && p < N_moments.at(depth-1) - 1)
+          check_recursion(kpm1, p + 1, reference);
       }
 			
     } else {
       KPM_Vector<T,D> *kpm0 = kpm_vector->at(0);
       KPM_Vector<T,D> *kpm1 = kpm_vector->at(depth);
 			
+      // The products sum over the nactive vectors of the block
+      accumulate reference = 0;
+      if(depth == 1)
+        reference = kpm1->interior_product(kpm1->get_index(), kpm1->get_index());
       kpm1->template Multiply<0>();		
-      gamma->matrix().block(0,*index_gamma,1,2) += (kpm0->v.adjoint() * kpm1->v - gamma->matrix().block(0,*index_gamma,1,2))/value_type(*average + 1);			
+      gamma->matrix().block(0,*index_gamma,1,2) = kpm0->adjoint_product(*kpm1);
       *index_gamma += 2;
 	
       for(int m = 2; m < N_moments.at(depth - 1); m += 2){
         kpm1->template Multiply<1>();
+        if(depth == 1)
+          check_recursion(kpm1, m, reference);
         kpm1->template Multiply<1>();
-        gamma->matrix().block(0, *index_gamma,1,2) += (kpm0->v.adjoint() * kpm1->v - gamma->matrix().block(0,*index_gamma,1,2))/value_type(*average + 1);
+        gamma->matrix().block(0, *index_gamma,1,2) = kpm0->adjoint_product(*kpm1);
             
         *index_gamma += 2;
       }
@@ -616,6 +955,8 @@ public:
 	} else {
 	  if(single_char == 'y'){
 	    single_digit = 1;
+	  } else if(single_char == 'z' && D == 3){
+	    single_digit = 2;
 	  } else {
 	    // This block should never run
 	    std::cout << "Please enter a valid expression.\n";
@@ -633,75 +974,122 @@ public:
     return indices;
   }
 
-  void store_gamma(Eigen::Array<T, -1, -1> *gamma, std::vector<int> N_moments, std::vector<std::vector<unsigned>> indices, std::string name_dataset){
-    debug_message("Entered store_gamma\n");
-    /* Depending on the type of Gamma matrix we're calculating, there may be some symmetries
-     * among the matrix entries that could be taken into account.
-     * 
-     * */
-
+  void record_norm(accumulate norm, accumulate reference, int moment){
+    // Squared norms of a Chebyshev vector and of the vector its recursion started from,
+    // in the domain of this thread. They are checked at the end of the sample by check_norms
+    norms.push_back(norm);
+    norms.push_back(reference);
+    norm_moments.push_back(moment);
+  }
 
+  bool norm_check(int moment){
+    // The norms of the Chebyshev vectors are recorded every NORM_CHECK moments
+    return moment > 0 && moment % NORM_CHECK == 0;
+  }
 
-    long int size_gamma = gamma->cols();
-    int dim = indices.size();
+  void check_recursion(KPM_Vector<T,D> * kpm, int moment, accumulate reference){
+    // Records the norm of the current column of a Chebyshev recursion every NORM_CHECK moments,
+    // reference being the norm of the vector the recursion started from
+    if(norm_check(moment)){
+      int current = kpm->get_index();
+      record_norm(kpm->interior_product(current, current), reference, moment);
+    }
+  }
 
-		
-    // Number of commutators inside the Gamma matrix. 
-    // V^{x}  = [x,H]		-> one commutator
-    // V^{xy} = [x,[y,H]]	-> two commutators
-    // This is important because the commutator is anti-hermitian. So, an odd number of commutators
-    // means that the conjugate of the Gamma matrix has an overall minus sign
-    int num_velocities = 0;
-    for(int i = 0; i < int(indices.size()); i++)
-      num_velocities += indices.at(i).size();
-		
-    int factor = 1 - (num_velocities % 2)*2;
-		
-    //std::cout << "gamma: " << *gamma << "\n";
-    
-    switch(dim){
-      case 2:{
-        Eigen::Array<T,-1,-1> general_gamma = Eigen::Map<Eigen::Array<T,-1,-1>>(gamma->data(), N_moments.at(0), N_moments.at(1));
-#pragma omp master
-        Global.general_gamma = Eigen::Array<T, -1, -1 > :: Zero(N_moments.at(0), N_moments.at(1));
-#pragma omp barrier
-#pragma omp critical
-        Global.general_gamma.matrix() += (general_gamma.matrix() + factor*general_gamma.matrix().adjoint())/2.0;
+  void check_norms(bool & diverged){
+    /* |T_n(H)| <= 1 in the spectrum, so <n|n> <= <0|0> unless the scaling of the Hamiltonian
+     * is too small or the single precision recursion lost its accuracy. The norms recorded by
+     * all the threads are summed, because each of them only has the part of its domain, and
+     * the master warns once for each calculation
+     * */
+    Global.statistics.parts.at(r.thread_id) = norms.data();
 #pragma omp barrier
-        break;
-      }
-      case 1:{
-        Eigen::Array<T,-1,-1> general_gamma = Eigen::Map<Eigen::Array<T,-1,-1>>(gamma->data(), 1, size_gamma);
 #pragma omp master
-        Global.general_gamma = Eigen::Array<T, -1, -1 > :: Zero(1, size_gamma);
-#pragma omp barrier
-#pragma omp critical
-        Global.general_gamma += general_gamma;
-#pragma omp barrier
-        break;
+    for(std::size_t i = 0; i < norm_moments.size() && !diverged; i++){
+      accumulate_value norm = std::abs(Global.statistics.sum(2*i));
+      accumulate_value reference = std::abs(Global.statistics.sum(2*i + 1));
+      if(!(norm <= accumulate_value(2)*reference)){
+        diverged = true;
+        std::cout << "Warning: the norm of the KPM vector grew to " << norm/reference
+                  << " times the initial one at moment " << norm_moments.at(i) << ". The moments may be wrong, check the scale factor.\n" << std::flush;
       }
-      case 3:{
-        Eigen::Array<T,-1,-1> general_gamma = Eigen::Map<Eigen::Array<T,-1,-1>>(gamma->data(), N_moments.at(2), N_moments.at(1)*N_moments.at(2));
-#pragma omp master
-        Global.general_gamma = Eigen::Array<T, -1, -1 > :: Zero(N_moments.at(2), N_moments.at(1)*N_moments.at(2));
+    }
 #pragma omp barrier
-#pragma omp critical
-        Global.general_gamma += general_gamma;
+    norms.clear();
+    norm_moments.clear();
+  }
+
+  void start_statistics(long int size_gamma){
+    // Clears the mean and the variance of the Gamma matrix before its first sample
+#pragma omp master
+    Global.statistics.reset(size_gamma, r.n_threads);
 #pragma omp barrier
+  }
 
-        break;
-      }
-      default:
-          std::cout << "You're trying to store a matrix that is not expected by the program. Exiting.\n";
-          exit(1);
-      }
+  void add_sample(Eigen::Array<accumulate, -1, -1> & gamma, int nactive, std::vector<int> N_moments, std::vector<std::vector<unsigned>> indices){
+    /* The sample is the sum of the products of the nactive random vectors of the block in the domain
+     * of this thread. It enters the mean and the variance summed over all the threads
+     * 
+     * */
+    if(indices.size() == 2){
+      // Number of commutators inside the Gamma matrix. 
+      // V^{x}  = [x,H]		-> one commutator
+      // V^{xy} = [x,[y,H]]	-> two commutators
+      // This is important because the commutator is anti-hermitian. So, an odd number of commutators
+      // means that the conjugate of the Gamma matrix has an overall minus sign.
+      // Each sample is symmetrized, so that the variance is the one of the symmetrized matrix
+      int num_velocities = indices.at(0).size() + indices.at(1).size();
+      int factor = 1 - (num_velocities % 2)*2;
+      Eigen::Map<Eigen::Matrix<accumulate, -1, -1>> g(gamma.data(), N_moments.at(0), N_moments.at(1));
+      g = ((g + accumulate_value(factor)*g.adjoint())/accumulate_value(2)).eval();
+    }
     
+    // Each thread sums the parts of all the threads in a slice of the elements
+    Global.statistics.parts.at(r.thread_id) = gamma.data();
+#pragma omp barrier
+    std::size_t size = gamma.size();
+    Global.statistics.add(size*r.thread_id/r.n_threads, size*(r.thread_id + 1)/r.n_threads, nactive);
+#pragma omp barrier
+#pragma omp master
+    Global.statistics.count(nactive);
+  }
 
-    
+  void store_gamma(std::vector<int> N_moments, std::vector<std::vector<unsigned>> indices, std::string name_dataset){
+    debug_message("Entered store_gamma\n");
+    /* The mean of the Gamma matrix is stored as T, and the standard errors of its elements, with
+     * the same shape, are stored next to it in name_dataset + "Error". The errors of the real and
+     * imaginary parts are in the real and imaginary parts of the errors. With a single sample
+     * there is no estimate of the errors, and they are not stored
+     * */
+#pragma omp barrier
 #pragma omp master
     {
+      long int size_gamma = Global.statistics.mean.size();
+      long int rows;
+      switch(indices.size()){
+      case 2:
+        rows = N_moments.at(0);
+        break;
+      case 1:
+        rows = 1;
+        break;
+      case 3:
+        rows = N_moments.at(2);
+        break;
+      default:
+        std::cout << "You're trying to store a matrix that is not expected by the program. Exiting.\n";
+        exit(1);
+      }
+      
+      // The moments were accumulated in the type of the products, they are stored as T
+      Global.general_gamma = Eigen::Map<Eigen::Array<accumulate,-1,-1>>(Global.statistics.mean.data(), rows, size_gamma/rows).template cast<T>();
       H5::H5File * file = new H5::H5File(name, H5F_ACC_RDWR);
       write_hdf5(Global.general_gamma, file, name_dataset);
+      if(Global.statistics.samples > 1){
+        Eigen::Array<accumulate,-1,-1> error = Global.statistics.standard_error();
+        Eigen::Array<T,-1,-1> general_error = Eigen::Map<Eigen::Array<accumulate,-1,-1>>(error.data(), rows, size_gamma/rows).template cast<T>();
+        write_hdf5(general_error, file, name_dataset + "Error");
+      }
       delete file;
     }
 #pragma omp barrier    
@@ -718,7 +1106,10 @@ public:
     KPM_Vector<T,D> kpm1(2, *this);
 		
 		
+    // The vector of the estimate does not change the random vectors of the calculations
+    const std::uint64_t vectors = rnd.vectors;
     kpm0.initiate_vector();
+    rnd.vectors = vectors;
     kpm1.set_index(0);
     kpm1.v.col(0) = kpm0.v.col(0);
     kpm1.template Multiply<0>(); 
@@ -768,29 +1159,30 @@ public:
     
 
 		// initialize the kpm vectors necessary for this calculation
-    typedef typename extract_value_type<T>::value_type value_type;
 
     // if the SSPRINT flag is true, we need one kpm vector for the right vector
     // and one for the left vector. Otherwise, we can just recycle it
+    // Every KPM vector holds a block of nblock random vectors
+    unsigned nblock = std::min(Global.block_size, unsigned(NRandomV));
 #if (SSPRINT == 0)
-    KPM_Vector<T,D> phi (2, *this);
+    KPM_Vector<T,D> phi (2, *this, nblock);
 #elif (SSPRINT != 0)
-    KPM_Vector<T,D> phir1 (2, *this);
-    KPM_Vector<T,D> phir2 (2, *this);
+    KPM_Vector<T,D> phir1 (2, *this, nblock);
+    KPM_Vector<T,D> phir2 (2, *this, nblock);
 #endif
 
     // right and left vectors
-    KPM_Vector<T,D> phi0(1, *this);
-    KPM_Vector<T,D> phi1(1, *this);
+    KPM_Vector<T,D> phi0(1, *this, nblock);
+    KPM_Vector<T,D> phi1(1, *this, nblock);
     
     // if SSPRINT is true, we need a temporary vector to store v|phi>
 #if (SSPRINT != 0)
-    KPM_Vector<T,D> phi2(1, *this);
+    KPM_Vector<T,D> phi2(1, *this, nblock);
 #endif
 	
     // initialize the conductivity array
-    Eigen::Array<T, -1, -1> cond_array;
-    cond_array = Eigen::Array<T, -1, -1>::Zero(1, N_energies);
+    Eigen::Array<accumulate, -1, -1> cond_array;
+    cond_array = Eigen::Array<accumulate, -1, -1>::Zero(1, N_energies);
 #if (SSPRINT != 0)
 #pragma omp master
           {
@@ -800,6 +1192,7 @@ public:
 #pragma omp barrier 
 #endif
     long average = 0;
+    bool diverged = false;
     double job_energy, job_gamma, job_preserve_disorder;
     int job_NMoments;
     for(int disorder = 0; disorder < NDisorder; disorder++){
@@ -824,12 +1217,13 @@ public:
 
         long average_R = average;
         // iteration over disorder and the number of random vectors
-        for(int randV = 0; randV < NRandomV; randV++){
+        for(int randV = 0; randV < NRandomV; randV += nblock){
+          int nactive = std::min(int(nblock), NRandomV - randV);
                    
 #if (SSPRINT == 0)
           debug_message("Started SingleShot calculation for SSPRINT=0\n");
           // initialize the random vector
-          phi0.initiate_vector();					
+          phi0.initiate_vector(nactive);					
           phi0.Exchange_Boundaries(); 	
           phi1.v.col(0).setZero();
 
@@ -837,10 +1231,15 @@ public:
           // the left vector is multiplied by the velocity
           phi.set_index(0);				
           generalized_velocity(&phi, &phi0, indices, 0);      // |phi> = v |phi_0>
+          accumulate left_norm = phi.interior_product(0, 0);
+          accumulate right_norm = phi0.interior_product(0, 0);
 
 
           for(int n = 0; n < job_NMoments; n++){		
-            if(n!=0) cheb_iteration(&phi, n-1);
+            if(n!=0){
+              cheb_iteration(&phi, n-1);
+              check_recursion(&phi, n, left_norm);
+            }
 
             phi1.v.col(0) += phi.v.col(phi.get_index())
               *green(n, 1, energy).imag()/(1.0 + int(n==0));
@@ -860,7 +1259,10 @@ public:
           phi0.v.col(0).setZero(); 
 
           for(int n = 0; n < job_NMoments; n++){		
-            if(n!=0) cheb_iteration(&phi, n-1);
+            if(n!=0){
+              cheb_iteration(&phi, n-1);
+              check_recursion(&phi, n, right_norm);
+            }
             
             phi0.v.col(0) += phi.v.col(phi.get_index())
               *green(n, 1, energy).imag()/(1.0 + int(n==0));
@@ -868,8 +1270,8 @@ public:
           
           
           // finally, the dot product of phi1 and phi0 yields the conductivity
-          cond_array(job_index) += (T(phi1.v.col(0).adjoint()*phi0.v.col(0)) - 
-              cond_array(job_index))/value_type(average_R+1);						
+          cond_array(job_index) += (phi1.adjoint_product(phi0)(0,0) - 
+              accumulate_value(nactive)*cond_array(job_index))/accumulate_value(average_R + nactive);						
           debug_message("Concluded SingleShot calculation for SSPRINT=0\n");
 #elif (SSPRINT != 0)
 #pragma omp master
@@ -879,7 +1281,7 @@ public:
 #pragma omp barrier
           debug_message("Started SingleShot calculation for SSPRINT!=0\n");
           // initialize the random vector
-          phi0.initiate_vector();					
+          phi0.initiate_vector(nactive);					
           phi0.Exchange_Boundaries(); 	
           phi1.v.col(0).setZero();
 
@@ -889,13 +1291,18 @@ public:
 
           phir2.v.col(0) = phi0.v.col(0);
           generalized_velocity(&phir1, &phi0, indices, 0);      // |phi> = v |phi_0>
+          accumulate left_norm = phir1.interior_product(0, 0);
+          accumulate right_norm = phir2.interior_product(0, 0);
           // from here on, phi0 is free to be used elsewhere, it is no longer needed
           phi0.v.col(0).setZero();
 
           for(int nn = 0; nn < SSPRINT; nn++){
 
             for(int n = nn*job_NMoments/SSPRINT; n < job_NMoments/SSPRINT*(nn+1); n++){	
-              if(n!=0) cheb_iteration(&phir1, n-1);
+              if(n!=0){
+                cheb_iteration(&phir1, n-1);
+                check_recursion(&phir1, n, left_norm);
+              }
 
               phi1.v.col(0) += phir1.v.col(phir1.get_index())
                 *green(n, 1, energy).imag()/(1.0 + int(n==0));
@@ -911,7 +1318,10 @@ public:
           
             
             for(int n = nn*job_NMoments/SSPRINT; n < job_NMoments/SSPRINT*(nn+1); n++){		
-              if(n!=0) cheb_iteration(&phir2, n-1);
+              if(n!=0){
+                cheb_iteration(&phir2, n-1);
+                check_recursion(&phir2, n, right_norm);
+              }
 
               phi0.v.col(0) += phir2.v.col(phir2.get_index())
                 *green(n, 1, energy).imag()/(1.0 + int(n==0));
@@ -920,26 +1330,27 @@ public:
             // This is the conductivity for a smaller number of chebyshev moments
             // if you want to add it to the average conductivity, you have yo wait
             // until all the moments have been summed. otherwise the result would be wrong
-            T temp;
-            temp = T(phi2.v.col(0).adjoint()*phi0.v.col(0));
+            accumulate temp;
+            temp = phi2.adjoint_product(phi0)(0,0);
 
 
             if(nn == SSPRINT-1){
-              cond_array(job_index) += (temp - cond_array(job_index))/value_type(average_R+1);
+              cond_array(job_index) += (temp - accumulate_value(nactive)*cond_array(job_index))/accumulate_value(average_R + nactive);
             }
             
 #pragma omp master
             {
             std::cout << "   energy: " << (energy*EScale).real() << " broadening: "
               << (energy*EScale).imag() << " moments: "; 
-            std::cout << job_NMoments/SSPRINT*(nn+1) << " SS_Cond: " << temp*factor*(1.0*omp_get_num_threads()) << "\n" << std::flush;
+            std::cout << job_NMoments/SSPRINT*(nn+1) << " SS_Cond: " << temp*factor*(1.0*omp_get_num_threads())/accumulate_value(nactive) << "\n" << std::flush;
             if(nn == SSPRINT-1)
               std::cout << "\n";
             }
 #pragma omp barrier
           }
 #endif
-            average_R++;
+            check_norms(diverged);
+            average_R += nactive;
             debug_message("Concluded SingleShot calculation for SSPRINT!=0\n");
         }
 #if (SSPRINT!=0)
@@ -967,7 +1378,7 @@ public:
     // in this case there's no problem. both V are anti-hermitic, so the minus signs cancel
 #pragma omp critical
     {
-    Global.singleshot_cond += cond_array;			
+    Global.singleshot_cond += cond_array.template cast<T>();			
     }
 #pragma omp barrier
     
@@ -0,0 +1,89 @@
+/****************************************************************/
+/*                                                              */
+/*  Copyright (C) 2018, M. Andelkovic, L. Covaci, A. Ferreira,  */
+/*                    S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                              */
+/****************************************************************/
+
+/*
+  Mean and variance of the Gamma matrices over the random vectors and the disorder realizations.
+
+  Each sample is the sum of the products of a block of random vectors, which is split among the
+  threads: every thread only has the part of its domain. The threads publish their parts, and
+  each of them sums the parts of all the threads over a slice of the elements and updates the
+  mean and the sum of the squared deviations of that slice with the weighted algorithm of
+  Welford (West). The samples are weighted by the number of random vectors of their blocks.
+
+  For complex moments the variances of the real and imaginary parts are kept separately, in the
+  real and imaginary parts of M2.
+*/
+
+// Product and square root of the real and imaginary parts separately
+template <typename U>
+U product_parts(U a, U b) { return a * b; };
+
+template <typename U>
+std::complex<U> product_parts(std::complex<U> a, std::complex<U> b) {
+  return std::complex<U>(a.real() * b.real(), a.imag() * b.imag());
+};
+
+template <typename U>
+U sqrt_parts(U a) { return std::sqrt(a); };
+
+template <typename U>
+std::complex<U> sqrt_parts(std::complex<U> a) {
+  return std::complex<U>(std::sqrt(a.real()), std::sqrt(a.imag()));
+};
+
+template <typename U>
+struct Statistics {
+  typedef typename extract_value_type<U>::value_type value_type;
+  Eigen::Array<U, -1, -1>  mean;
+  Eigen::Array<U, -1, -1>  M2;          // Sum of the weighted squared deviations from the mean
+  value_type               weight;      // Number of random vectors in the samples
+  long                     samples;     // Number of samples
+  std::vector<const U *>   parts;       // Part of the current sample in the domain of each thread
+
+  void reset(std::size_t size, unsigned n_threads) {
+    mean = Eigen::Array<U, -1, -1>::Zero(1, size);
+    M2   = Eigen::Array<U, -1, -1>::Zero(1, size);
+    weight  = 0;
+    samples = 0;
+    parts.assign(n_threads, nullptr);
+  };
+
+  U sum(std::size_t i) {
+    // Element i summed over the parts of all the threads
+    U x = 0;
+    for(auto p = parts.begin(); p != parts.end(); p++)
+      x += (*p)[i];
+    return x;
+  };
+
+  void add(std::size_t begin, std::size_t end, value_type w) {
+    // Updates the elements [begin, end) with the sample made of the parts of all the threads.
+    // The weight and the number of samples are only counted after all the slices are updated
+    const value_type total = weight + w;
+    for(std::size_t i = begin; i < end; i++)
+      {
+	const U y     = sum(i) / w;          // Mean of the random vectors of the sample
+	const U delta = y - mean(i);
+	mean(i) += delta * (w / total);
+	M2(i)   += w * product_parts(delta, U(y - mean(i)));
+      }
+  };
+
+  void count(value_type w) {
+    weight += w;
+    samples++;
+  };
+
+  Eigen::Array<U, -1, -1> standard_error() {
+    // The variance of a single random vector is M2/(samples - 1), and the error of the mean
+    // of weight vectors is the square root of that divided by the weight
+    Eigen::Array<U, -1, -1> error(1, mean.size());
+    for(long i = 0; i < mean.size(); i++)
+      error(i) = sqrt_parts(U(M2(i) / (weight * value_type(samples - 1))));
+    return error;
+  };
+};
@@ -0,0 +1,128 @@
+/****************************************************************/
+/*                                                              */
+/*  Copyright (C) 2018, M. Andelkovic, L. Covaci, A. Ferreira,  */
+/*                    S. M. Joao, J. V. Lopes, T. G. Rappoport  */
+/*                                                              */
+/****************************************************************/
+
+/*
+  Stencils of the regular hoppings specialized for a fixed number of hoppings per orbital:
+
+  y[i] += c * u[i] * x[i] + t[0] * x[i + d[0]] + ... + t[NH-1] * x[i + d[NH-1]]
+
+  The first term is the on-site energy u of the disorder realization, skipped when u is null.
+
+  The sum over the hoppings is unrolled at compile time, so the distances and the
+  coefficients stay in registers and each element of the row being updated is loaded
+  and stored once, instead of once per hopping. The kernels are instantiated for
+  NH = 1 ... STENCIL_MAX_HOPPINGS, which covers the square (4), honeycomb (3),
+  honeycomb with next-nearest neighbours (9) and the usual phosphorene models.
+  Orbitals with more hoppings use the generic path of SimdKernels, one axpy per hopping.
+  So do the complex types: the compiler does not vectorize the complex products as well
+  as the hand written kernels, and the fused loop was measured to be slower.
+*/
+
+#ifndef STENCIL_MAX_HOPPINGS
+#define STENCIL_MAX_HOPPINGS 12
+#endif
+
+template <typename T, unsigned NH, unsigned B = 0>
+struct stencil_sum {
+  static inline T eval(const T * x, const std::ptrdiff_t * d, const T * t) {
+    return t[B] * x[d[B]] + stencil_sum<T, NH, B + 1>::eval(x, d, t);
+  };
+};
+
+template <typename T, unsigned NH>
+struct stencil_sum<T, NH, NH> {
+  static inline T eval(const T *, const std::ptrdiff_t *, const T *) {
+    return T(0.);
+  };
+};
+
+#define STENCIL_ROW_BODY						\
+  std::ptrdiff_t dl[NH];						\
+  T tl[NH];								\
+  for(unsigned b = 0; b < NH; b++)					\
+    {									\
+      dl[b] = d[b];							\
+      tl[b] = t[b];							\
+    }									\
+  if(u == nullptr)							\
+    {									\
+      _Pragma("omp simd")						\
+      for(std::size_t i = 0; i < n; i++)				\
+	y[i] += stencil_sum<T, NH>::eval(x + i, dl, tl);		\
+    }									\
+  else									\
+    {									\
+      _Pragma("omp simd")						\
+      for(std::size_t i = 0; i < n; i++)				\
+	y[i] += c * u[i] * x[i] + stencil_sum<T, NH>::eval(x + i, dl, tl); \
+    }
+
+template <typename T, unsigned NH>
+void stencil_row(T * __restrict__ y, const T * __restrict__ x, const std::ptrdiff_t * d, const T * t, const T * u, T c, std::size_t n) {
+  STENCIL_ROW_BODY
+}
+
+#if SIMD_X86
+
+template <typename T, unsigned NH>
+__attribute__((target("avx2,fma")))
+void stencil_row_avx2(T * __restrict__ y, const T * __restrict__ x, const std::ptrdiff_t * d, const T * t, const T * u, T c, std::size_t n) {
+  STENCIL_ROW_BODY
+}
+
+template <typename T, unsigned NH>
+__attribute__((target("avx512f")))
+void stencil_row_avx512(T * __restrict__ y, const T * __restrict__ x, const std::ptrdiff_t * d, const T * t, const T * u, T c, std::size_t n) {
+  STENCIL_ROW_BODY
+}
+
+#endif
+
+#undef STENCIL_ROW_BODY
+
+template <typename T>
+struct Stencil {
+  typedef typename extract_value_type<T>::value_type value_type;
+  // The on-site energies are real. There are only stencils for the real types, where value_type is T
+  typedef void (*row_type)(T *, const T *, const std::ptrdiff_t *, const T *, const value_type *, value_type, std::size_t);
+
+  // Returns the kernel for nh hoppings, or a null pointer if there is no specialization
+  static row_type select(unsigned nh) {
+    if(nh == 0 || nh > STENCIL_MAX_HOPPINGS)
+      return nullptr;
+    return select(nh, std::integral_constant<bool, !is_tt<std::complex, T>::value>());
+  };
+
+private:
+  static row_type select(unsigned, std::false_type) {
+    return nullptr;
+  };
+
+  static row_type select(unsigned nh, std::true_type) {
+    return table<STENCIL_MAX_HOPPINGS>(nh);
+  };
+
+  template <unsigned NH>
+  static typename std::enable_if<(NH > 0), row_type>::type table(unsigned nh) {
+    if(nh != NH)
+      return table<NH - 1>(nh);
+#if SIMD_X86
+    switch(simd_level()) {
+    case 3:
+      return stencil_row_avx512<T, NH>;
+    case 2:
+      return stencil_row_avx2<T, NH>;
+    }
+#endif
+    return stencil_row<T, NH>;
+  };
+
+  template <unsigned NH>
+  static typename std::enable_if<NH == 0, row_type>::type table(unsigned) {
+    return nullptr;
+  };
+};
@@ -27,15 +27,28 @@
 #include <cmath>
 #include <math.h>
 #include <initializer_list>
+#include <array>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#endif
 
 // Set of compilation parameters chosen in the Makefile
-// MEMORY is the number of KPM vectors stored in the memory while calculating Gamma2D
-// STRIDE is the size of the memory blocks used in the program
+// MEMORY is the default number of KPM vectors stored in the memory while calculating Gamma2D (/Memory in the configuration file)
+// MEMORY_BUDGET is the default memory in MB for the KPM vectors of Gamma2D, which sets how many of them are stored (/MemoryBudget, 0 to use MEMORY)
+// STRIDE is the default size of the memory blocks used in the program (/Stride in the configuration file, 0 to autotune it)
 // COMPILE_MAIN is a flag to prevent compilation of unnecessary parts of the code when testing
 #ifndef MEMORY
 #define MEMORY 4
 #endif
 
+#ifndef MEMORY_BUDGET
+#define MEMORY_BUDGET 0
+#endif
+
 #ifndef STRIDE
 #define STRIDE 64
 #endif
@@ -56,12 +69,61 @@
 #define ESTIMATE_TIME 1
 #endif
 
+// SIMD selects the vector instructions used in the KPM iteration:
+// -1 detects them at runtime, 0 scalar, 1 SSE2, 2 AVX2, 3 AVX-512
+#ifndef SIMD
+#define SIMD -1
+#endif
+
+// SPLIT_COMPLEX=1 stores the real and imaginary parts of the complex KPM vectors in separate planes
+#ifndef SPLIT_COMPLEX
+#define SPLIT_COMPLEX 0
+#endif
+
+// MIXED_PRECISION=1 accumulates the products of the KPM vectors in single precision (PRECISION=0) in double
+#ifndef MIXED_PRECISION
+#define MIXED_PRECISION 0
+#endif
+
+// NORM_CHECK is the number of Chebyshev iterations between the checks that the norms of the KPM vectors stay bounded
+#ifndef NORM_CHECK
+#define NORM_CHECK 64
+#endif
+
+// ANDERSON_ON_THE_FLY=1 finds the Anderson disorder of each site with a counter-based generator when
+// it is needed, instead of storing it, which saves one real number per site of the lattice
+#ifndef ANDERSON_ON_THE_FLY
+#define ANDERSON_ON_THE_FLY 0
+#endif
+
+// SYMMETRIC_GAMMA=1 only calculates half of the Gamma matrices of the longitudinal conductivities,
+// such as Gamma^{x,x}, and finds the other half from Gamma(n,m) = conj(Gamma(m,n))
+#ifndef SYMMETRIC_GAMMA
+#define SYMMETRIC_GAMMA 1
+#endif
+
+// DIRECT_GHOSTS=1 reads the ghosts straight from the KPM vectors of the neighbouring threads,
+// 0 copies them through the shared buffers in Global.ghosts
+#ifndef DIRECT_GHOSTS
+#define DIRECT_GHOSTS 1
+#endif
+
+// PIN_THREADS=1 binds each thread to a core of the socket holding its domain, unless the binding is set in the environment (OMP_PROC_BIND, OMP_PLACES).
+// It is off by default, since it overrides the placement of the threads chosen by the batch system or the user
+#ifndef PIN_THREADS
+#define PIN_THREADS 0
+#endif
+
+// NUM_GHOST_CORR is the default number of flux quanta of the magnetic field (/Hamiltonian/MagneticField in the configuration file)
+#ifndef NUM_GHOST_CORR
+#define NUM_GHOST_CORR 0
+#endif
+
 // other compilation parameters not set in the Makefile
-// NGHOSTS is the extra length in each direction, to be used with the blocks of size STRIDE
+// NGHOSTS is the default extra length in each direction (/NGhosts in the configuration file)
 #define PATTERNS  4
 #define NGHOSTS   2
 #define VVERBOSE 0
-#define NUM_GHOST_CORR 0
 #define SSPRINT 0
 
 // These are the verbose and debug messages
@@ -112,14 +174,21 @@
 
 template<typename T, unsigned D>
 class Simulation;
-#include "Global.hpp"
 #include "ComplexTraits.hpp"
+#include "Statistics.hpp"
+#include "Global.hpp"
+#include "SimdKernels.hpp"
+#include "Stencils.hpp"
 #include "myHDF5.hpp"
+#include "Configuration.hpp"
 #include "Random.hpp"
 #include "LatticeStructure.hpp"
 #include "Hamiltonian.hpp"
 #include "KPM_Vector.hpp"
 #include "KPM_Vector2D.hpp"
+#include "KPM_Vector3D.hpp"
+#include "Affinity.hpp"
+#include "Arena.hpp"
 #include "Simulation.hpp"
 
 typedef int indextype;
@@ -190,7 +259,7 @@ int main(int argc, char *argv[]){
   // Verify if the values passed to the program are valid. If they aren't
   // the program should notify the user and exit with error 1.
   if(dim < 1 || dim > 3){
-    std::cout << "Invalid number of dimensions. The code is only valid for 2D. Exiting.\n";
+    std::cout << "Invalid number of dimensions. The code is only valid for 2D and 3D. Exiting.\n";
     exit(1);
   }
   if(precision < 0 || precision > 2){
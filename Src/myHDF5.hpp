@@ -16,6 +16,8 @@ H5::DataType DataTypeFor<int>::value = H5::PredType::NATIVE_INT;
 template<>
 H5::DataType DataTypeFor<unsigned int>::value = H5::PredType::NATIVE_UINT;
 template<>
+H5::DataType DataTypeFor<unsigned long long>::value = H5::PredType::NATIVE_ULLONG;
+template<>
 H5::DataType DataTypeFor<float>::value = H5::PredType::NATIVE_FLOAT;
 template<>
 H5::DataType DataTypeFor<double>::value = H5::PredType::NATIVE_DOUBLE;
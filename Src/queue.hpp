@@ -88,7 +88,7 @@ std::string num2str2(int dir_num){
     case 5:
       dir = "yx"; break;
     case 6:
-      dir = "yx"; break;
+      dir = "yz"; break;
     case 7:
       dir = "zx"; break;
     case 8:
@@ -117,12 +117,9 @@ class measurement_queue{
     };
 
 
-    void embed_time(double avg_duration){
-      int prod = 1;
-      for(unsigned int i = 0; i < NMoments.size(); i++)
-        prod *= NMoments.at(i);
-
-      time_length = prod*avg_duration*NDisorder*NRandom/MEMORY;
+    void embed_time(double avg_duration, double multiplications){
+      // multiplications is the number of multiplications by the Hamiltonian of each random vector
+      time_length = multiplications*avg_duration*NDisorder*NRandom;
     };
 };
 
@@ -316,6 +313,8 @@ std::vector<singleshot_measurement_queue> fill_singleshot_queue(char *name){
          direction_string = "x,x";
        else if(direction == 1)
          direction_string = "y,y";
+       else if(direction == 2)
+         direction_string = "z,z";
        else{
          std::cout << "Invalid singleshot direction. Exiting.\n";
          exit(1);
@@ -626,10 +626,51 @@ class Calculation:
                  'preserve_disorder': np.atleast_1d(preserve_disorder)})
 
 
+class Modification:
+
+    def __init__(self, magnetic_field=None, flux=None):
+        """Define special modifiers of the model
+
+       Parameters
+       ----------
+       magnetic_field : Optional[float]
+           Magnetic field in Tesla, perpendicular to the first two lattice vectors. The closest value commensurate
+           with the size of the system is used.
+       flux : Optional[float]
+           Magnetic flux through the unit cell, in units of the flux quantum. The closest value commensurate with the
+           size of the system is used.
+       """
+
+        if magnetic_field is not None and flux is not None:
+            raise SystemExit('Only one of magnetic_field and flux can be given.')
+        self._magnetic_field = magnetic_field
+        self._flux = flux
+
+    def flux_quanta(self, lattice, length):
+        """Returns the number of flux quanta N of the magnetic field, the flux through the unit cell being
+        N / length[1]."""
+        if self._magnetic_field is None and self._flux is None:
+            return 0
+        flux = self._flux
+        if flux is None:
+            # area of the unit cell in nm^2 and flux quantum h/e in T nm^2
+            vectors = np.asarray(lattice.vectors)
+            area = np.abs(np.linalg.det(vectors[0:2, 0:2]))
+            flux = self._magnetic_field * area / 4.135667696e3
+        num_quanta = int(round(flux * length[1]))
+        if abs(num_quanta) >= length[1]:
+            raise SystemExit('The flux through the unit cell has to be smaller than one flux quantum.')
+        print('\nThe commensurate flux through the unit cell is', num_quanta / length[1], 'flux quanta.\n')
+        if num_quanta == 0:
+            print('WARNING: the magnetic field is too small for the size of the system and is set to zero.')
+        return num_quanta
+
+
 class Configuration:
 
     def __init__(self, divisions=(1, 1), length=(1, 1), boundaries=(False, False), is_complex=False, precision=1,
-                 spectrum_range=None):
+                 spectrum_range=None, block_size=1, stride=None, memory=None, memory_budget=None,
+                 seed=None):
         """Define basic parameters used in the calculation
 
        Parameters
@@ -649,6 +690,25 @@ class Configuration:
             Energy scale which defines the scaling factor of all the energy related parameters. The scaling is done
             automatically in the background after this definition. If the term is not specified, a rough estimate of the
             bounds is found.
+       block_size : int
+            Number of random vectors that are iterated together through the Chebyshev recursion. Values larger than 1
+            share the lattice data among the vectors of each block, at the cost of block_size times more memory per
+            KPM vector.
+       stride : Optional[int]
+            Size of the tiles swept by each Chebyshev iteration. With stride=0 the fastest size for the system is measured before the calculation starts. If the term is not
+            specified, the default of the C++ code is used.
+       memory : Optional[int]
+            Number of KPM vectors kept in memory in the calculation of the conductivities. The number of moments has to
+            be a multiple of it. If the term is not specified, the default of the C++ code is used.
+       memory_budget : Optional[float]
+            Memory in MB for the KPM vectors kept in memory in the calculation of the conductivities, summed over all
+            the threads. When it is given, the number of vectors kept is the largest that fits in it and divides the
+            numbers of moments, which cuts the number of Chebyshev iterations. It replaces memory.
+            The number chosen depends on the divisions, because each thread also stores its ghosts, but the results do not.
+       seed : Optional[int]
+            Seed of the random numbers of the disorder and of the random vectors. The results of two calculations with
+            the same seed are the same for any divisions, block_size, memory and memory_budget. If the term is not
+            specified, a new seed is drawn in each run.
        """
 
         if spectrum_range:
@@ -664,6 +724,11 @@ class Configuration:
         self._boundaries = np.asarray(boundaries).astype(int)
 
         self._length = length
+        self._block_size = block_size
+        self._stride = stride
+        self._memory = memory
+        self._memory_budget = memory_budget
+        self._seed = seed
         self._htype = np.float32
         self.set_type()
 
@@ -721,6 +786,31 @@ class Configuration:
         """Return the number of unit cell repetitions in each direction. """
         return self._length
 
+    @property
+    def block_size(self):  # -> block_size:
+        """Return the number of random vectors iterated together. """
+        return self._block_size
+
+    @property
+    def stride(self):  # -> stride:
+        """Return the size of the tiles, 0 to choose it automatically, or None for the default. """
+        return self._stride
+
+    @property
+    def memory(self):  # -> memory:
+        """Return the number of KPM vectors kept in memory, or None for the default. """
+        return self._memory
+
+    @property
+    def memory_budget(self):  # -> memory_budget:
+        """Return the memory in MB for the KPM vectors kept in memory, or None for the default. """
+        return self._memory_budget
+
+    @property
+    def seed(self):  # -> seed:
+        """Return the seed of the random numbers, or None to draw a new one in each run. """
+        return self._seed
+
     @property
     def type(self):  # -> type:
         """Return the type of the Hamiltonian complex or real, and float, double or long double. """
@@ -971,7 +1061,7 @@ def config_system(lattice, config, calculation, **kwargs):
         in the calculation.
     calculation : Calculation
         Calculation object that defines the requested functions for the calculation.
-    **kwargs: Optional arguments like filename, Disorder or Disorder_structural.
+    **kwargs: Optional arguments like filename, Disorder, Disorder_structural or Modification.
 
     """
 
@@ -1002,6 +1092,16 @@ def config_system(lattice, config, calculation, **kwargs):
         config._is_complex = 1
         config.set_type()
 
+    # the phases of the magnetic field need a complex Hamiltonian
+    modification = kwargs.get('modification', None)
+    flux_quanta = 0
+    if modification:
+        flux_quanta = modification.flux_quanta(lattice, config.leng)
+    if flux_quanta != 0 and complx == 0:
+        print('Magnetic field is added but is_complex identifier is 0. Automatically turning is_complex to 1!')
+        config._is_complex = 1
+        config.set_type()
+
     # hamiltonian is complex 1 or real 0
     complx = int(config.comp)
 
@@ -1150,9 +1250,9 @@ def config_system(lattice, config, calculation, **kwargs):
                                                                                            '\nINFO: this product will correspond to the total number of threads. '
                                                                                            '\nYou should choose at most the number of processor cores you have.'
                                                                                            '\nWARNING: System size need\'s to be an integer multiple of \n'
-                                                                                           '[STRIDE * ', config.div[0],
-          ' and STRIDE * ', config.div[1], '] '
-                                           '\nwhere STRIDE is selected when compiling the C++ code. \n')
+                                                                                           '[', config.div[0],
+          ' and ', config.div[1], '], and each part needs to be at least as long as the width of the ghosts '
+                                  '(2 by default) in every direction.\n')
 
     f.create_dataset('Divisions', data=config.div, dtype='u4')
     # space dimension of the lattice 1D, 2D, 3D
@@ -1167,6 +1267,18 @@ def config_system(lattice, config, calculation, **kwargs):
     f.create_dataset('EnergyScale', data=config.energy_scale, dtype=np.float64)
     # shift factor for the hopping parameters
     f.create_dataset('EnergyShift', data=config.energy_shift, dtype=np.float64)
+    # number of random vectors iterated together
+    f.create_dataset('BlockSize', data=config.block_size, dtype='u4')
+    # size of the tiles and number of KPM vectors kept in memory, optional
+    if config.stride is not None:
+        f.create_dataset('Stride', data=config.stride, dtype='u4')
+    if config.memory is not None:
+        f.create_dataset('Memory', data=config.memory, dtype=np.int32)
+    if config.memory_budget is not None:
+        f.create_dataset('MemoryBudget', data=config.memory_budget, dtype=np.float64)
+    # seed of the random numbers, optional
+    if config.seed is not None:
+        f.create_dataset('Seed', data=config.seed, dtype='u8')
     # Hamiltonian group
     grp = f.create_group('Hamiltonian')
     # Hamiltonian group
@@ -1181,6 +1293,10 @@ def config_system(lattice, config, calculation, **kwargs):
         # hoppings
         grp.create_dataset('Hoppings', data=(t.real.astype(config.type)) / config.energy_scale)
 
+    # number of flux quanta of the magnetic field
+    if flux_quanta != 0:
+        grp.create_dataset('MagneticField', data=flux_quanta, dtype=np.int32)
+
     grp_dis = grp.create_group('Disorder')
 
     if disorder: